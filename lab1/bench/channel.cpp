@@ -0,0 +1,83 @@
+#include <channel.h>
+#include <chloros.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+// Round trip latency between two green threads passing a value back and forth
+// through a pair of channels, next to a round trip of two bare context
+// switches. Since a send to a parked receiver switches straight to it, a
+// channel round trip should cost little more than the switches themselves.
+
+extern "C" {
+void ContextSwitch(chloros::Context* old_context,
+                   chloros::Context* new_context) __asm__("context_switch");
+}
+
+constexpr int const kRoundTrips = 1000000;
+
+chloros::Context main_context{};
+chloros::Context bouncer_context{};
+
+void Bouncer() {
+  for (;;) {
+    ContextSwitch(&bouncer_context, &main_context);
+  }
+}
+
+double BareContextSwitch() {
+  alignas(16) static uint8_t stack[1 << 16];
+  // `context_switch` returns into `Bouncer` with the stack aligned the way a
+  // call would leave it.
+  auto top = reinterpret_cast<void**>(stack + sizeof(stack)) - 2;
+  *top = reinterpret_cast<void*>(Bouncer);
+  bouncer_context.rsp = reinterpret_cast<uint64_t>(top);
+  bouncer_context.mxcsr = 0x1F80;
+  bouncer_context.x87 = 0x037F;
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < kRoundTrips; ++i) {
+    ContextSwitch(&main_context, &bouncer_context);
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  return elapsed.count() / kRoundTrips;
+}
+
+struct PingPong {
+  explicit PingPong(size_t capacity) : ping{capacity}, pong{capacity} {}
+  chloros::Channel<int> ping;
+  chloros::Channel<int> pong;
+};
+
+void Ponger(void* arg) {
+  auto channels = static_cast<PingPong*>(arg);
+  int value;
+  while (channels->ping.Receive(&value)) {
+    channels->pong.Send(value + 1);
+  }
+}
+
+double ChannelPingPong(size_t capacity) {
+  PingPong channels{capacity};
+  chloros::Spawn(Ponger, &channels);
+  int value = 0;
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < kRoundTrips; ++i) {
+    channels.ping.Send(value);
+    channels.pong.Receive(&value);
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  channels.ping.Close();
+  chloros::Wait();
+  return elapsed.count() / kRoundTrips;
+}
+
+int main() {
+  chloros::Initialize();
+  printf("%-28s %s\n", "benchmark", "ns/round trip");
+  printf("%-28s %.1f\n", "bare ContextSwitch", BareContextSwitch());
+  printf("%-28s %.1f\n", "channel, capacity 0", ChannelPingPong(0));
+  printf("%-28s %.1f\n", "channel, capacity 1", ChannelPingPong(1));
+  return 0;
+}
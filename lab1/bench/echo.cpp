@@ -0,0 +1,133 @@
+#include <chloros.h>
+#include <io.h>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Echo server and its clients over loopback TCP, all on a single kernel
+// thread. Every connection gets a green thread on each side that does plain
+// blocking reads and writes, and the scheduler multiplexes them. Each count of
+// connections runs twice: once with reads and writes that would block waiting
+// for epoll and then trying again, and once with them handed to io_uring. The
+// total number of round trips is the same for every row, so the rows show what
+// more connections cost.
+
+constexpr int const kRoundTrips = 100000;
+constexpr int const kMessageSize = 64;
+constexpr int const kConnectionCounts[] = {1, 10, 100, 1000, 4000};
+
+int listener = -1;
+sockaddr_in server_address{};
+int connections = 0;
+int round_trips_per_connection = 0;
+
+void Echo(void* arg) {
+  int fd = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+  char buffer[kMessageSize];
+  ssize_t n;
+  while ((n = chloros::io::Read(fd, buffer, sizeof(buffer))) > 0) {
+    chloros::io::Write(fd, buffer, n);
+  }
+  close(fd);
+}
+
+void Acceptor(void*) {
+  for (int i = 0; i < connections; ++i) {
+    int fd = chloros::io::Accept(listener, nullptr, nullptr);
+    if (fd < 0) {
+      perror("accept");
+      return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    chloros::SpawnDetached(Echo, reinterpret_cast<void*>(intptr_t{fd}));
+  }
+}
+
+void Client(void*) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (chloros::io::Connect(fd, reinterpret_cast<sockaddr*>(&server_address),
+                           sizeof(server_address)) != 0) {
+    perror("connect");
+    close(fd);
+    return;
+  }
+  char message[kMessageSize] = {};
+  for (int i = 0; i < round_trips_per_connection; ++i) {
+    chloros::io::Write(fd, message, sizeof(message));
+    size_t got = 0;
+    while (got < sizeof(message)) {
+      ssize_t n = chloros::io::Read(fd, message + got, sizeof(message) - got);
+      if (n <= 0) {
+        close(fd);
+        return;
+      }
+      got += n;
+    }
+  }
+  close(fd);
+}
+
+double Run(int n) {
+  connections = n;
+  round_trips_per_connection = kRoundTrips / n;
+  auto begin = std::chrono::steady_clock::now();
+  chloros::SpawnDetached(Acceptor, nullptr);
+  for (int i = 0; i < n; ++i) {
+    chloros::SpawnDetached(Client, nullptr);
+  }
+  chloros::Wait();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  return elapsed.count();
+}
+
+int main() {
+  // Two descriptors per connection, and then some.
+  rlimit limit{};
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+
+  chloros::Initialize();
+  listener = socket(AF_INET, SOCK_STREAM, 0);
+  server_address.sin_family = AF_INET;
+  server_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(server_address);
+  if (bind(listener, reinterpret_cast<sockaddr*>(&server_address),
+           sizeof(server_address)) != 0 ||
+      getsockname(listener, reinterpret_cast<sockaddr*>(&server_address),
+                  &length) != 0 ||
+      listen(listener, SOMAXCONN) != 0) {
+    perror("listen");
+    return 1;
+  }
+
+  printf("%-14s %-10s %-12s %-16s %s\n", "connections", "backend", "seconds",
+         "round_trips/s", "us/round_trip");
+  for (int n : kConnectionCounts) {
+    if (static_cast<rlim_t>(2 * n + 16) > limit.rlim_cur) {
+      printf("%-14d skipped, not enough file descriptors\n", n);
+      continue;
+    }
+    for (bool uring : {false, true}) {
+      chloros::io::SetUringSockets(uring);
+      double seconds = Run(n);
+      double round_trips =
+          static_cast<double>(n) * round_trips_per_connection;
+      printf("%-14d %-10s %-12.3f %-16.0f %.2f\n", n,
+             uring ? "io_uring" : "epoll", seconds, round_trips / seconds,
+             seconds * 1e6 / round_trips);
+    }
+  }
+  close(listener);
+  return 0;
+}
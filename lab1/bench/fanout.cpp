@@ -0,0 +1,69 @@
+#include <chloros.h>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+// Fanning out 10k green threads from one thread, with the eager `Spawn` that
+// switches to every new thread right away, with `SpawnDetached`, and with a
+// single `SpawnMany`. Reports the time until the last thread is queued, and
+// until all of them are done. With a non-yielding spawn all 10k threads are
+// alive at once, so the stack cache is made large enough to hold them; the
+// first run warms it up. Otherwise every thread maps and unmaps a fresh stack,
+// and that dominates everything else.
+
+constexpr int const kThreads = 10000;
+constexpr int const kRuns = 10;
+
+long sum = 0;
+
+void Worker(void* arg) { sum += reinterpret_cast<long>(arg); }
+
+using Clock = std::chrono::steady_clock;
+
+template <typename F>
+void Run(char const* name, F&& fan_out) {
+  double spawn_us = 0;
+  double total_us = 0;
+  for (int run = 0; run < kRuns; ++run) {
+    sum = 0;
+    auto begin = Clock::now();
+    fan_out();
+    auto spawned = Clock::now();
+    chloros::Wait();
+    auto done = Clock::now();
+    if (sum != static_cast<long>(kThreads) * (kThreads - 1) / 2) {
+      fprintf(stderr, "%s: wrong sum %ld\n", name, sum);
+    }
+    spawn_us +=
+        std::chrono::duration<double, std::micro>(spawned - begin).count();
+    total_us += std::chrono::duration<double, std::micro>(done - begin).count();
+  }
+  printf("%-16s %-16.1f %-16.1f %.1f\n", name, spawn_us / kRuns,
+         total_us / kRuns, total_us * 1000 / kRuns / kThreads);
+}
+
+int main() {
+  chloros::Initialize();
+  chloros::SetStackCacheLimit(kThreads);
+  std::vector<void*> args{};
+  for (long i = 0; i < kThreads; ++i) {
+    args.push_back(reinterpret_cast<void*>(i));
+  }
+  chloros::SpawnMany(Worker, args.data(), args.size());
+  chloros::Wait();
+  printf("%-16s %-16s %-16s %s\n", "api", "spawn_us", "total_us",
+         "ns/thread");
+  Run("Spawn", [&] {
+    for (auto&& arg : args) {
+      chloros::Spawn(Worker, arg);
+    }
+  });
+  Run("SpawnDetached", [&] {
+    for (auto&& arg : args) {
+      chloros::SpawnDetached(Worker, arg);
+    }
+  });
+  Run("SpawnMany",
+      [&] { chloros::SpawnMany(Worker, args.data(), args.size()); });
+  return 0;
+}
@@ -0,0 +1,115 @@
+#include <chloros.h>
+#include <io.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <vector>
+
+// Random 4 KB reads from a local file by many green threads on one kernel
+// thread, through io_uring and through the helper threads, next to plain
+// blocking `pread` calls. The file is small enough to stay in the page cache,
+// so this measures the overhead of each path rather than the disk, and how
+// well io_uring batches: every system call that is there for the reads is
+// counted, including submissions, polls for completions and helper wakeups.
+
+constexpr size_t const kFileSize = size_t{64} << 20;
+constexpr size_t const kBlockSize = 4096;
+constexpr int const kReads = 200000;
+constexpr int const kThreadCounts[] = {1, 16, 64, 256};
+
+int file = -1;
+int reads_per_thread = 0;
+
+uint64_t Random(uint64_t& state) {
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+void Reader(void* arg) {
+  uint64_t state = reinterpret_cast<uintptr_t>(arg) * 2654435761u + 1;
+  alignas(kBlockSize) char buffer[kBlockSize];
+  for (int i = 0; i < reads_per_thread; ++i) {
+    off_t offset = Random(state) % (kFileSize / kBlockSize) * kBlockSize;
+    if (chloros::io::PRead(file, buffer, kBlockSize, offset) !=
+        static_cast<ssize_t>(kBlockSize)) {
+      perror("read");
+      exit(1);
+    }
+  }
+}
+
+void Report(char const* backend, int threads, double seconds, int reads,
+            uint64_t system_calls) {
+  printf("%-10s %-9d %-12.0f %-10.2f %.3f\n", backend, threads,
+         reads / seconds, seconds * 1e9 / reads,
+         static_cast<double>(system_calls) / reads);
+}
+
+void RunGreen(char const* backend, int threads) {
+  reads_per_thread = kReads / threads;
+  auto before = chloros::io::GetFileIoStats();
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < threads; ++i) {
+    chloros::SpawnDetached(Reader, reinterpret_cast<void*>(uintptr_t(i)));
+  }
+  chloros::Wait();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  auto after = chloros::io::GetFileIoStats();
+  Report(backend, threads, elapsed.count(),
+         static_cast<int>(after.operations - before.operations),
+         after.system_calls - before.system_calls);
+}
+
+void RunBlocking() {
+  uint64_t state = 1;
+  alignas(kBlockSize) char buffer[kBlockSize];
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < kReads; ++i) {
+    off_t offset = Random(state) % (kFileSize / kBlockSize) * kBlockSize;
+    if (pread(file, buffer, kBlockSize, offset) !=
+        static_cast<ssize_t>(kBlockSize)) {
+      perror("read");
+      exit(1);
+    }
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  Report("pread", 1, elapsed.count(), kReads, kReads);
+}
+
+int main() {
+  char path[] = "/tmp/chloros_bench_file_XXXXXX";
+  file = mkstemp(path);
+  if (file < 0) {
+    perror("mkstemp");
+    return 1;
+  }
+  unlink(path);
+  std::vector<char> chunk(1 << 20, 'x');
+  for (size_t written = 0; written < kFileSize; written += chunk.size()) {
+    if (write(file, chunk.data(), chunk.size()) !=
+        static_cast<ssize_t>(chunk.size())) {
+      perror("write");
+      return 1;
+    }
+  }
+
+  chloros::Initialize();
+  printf("%-10s %-9s %-12s %-10s %s\n", "backend", "threads", "reads/s",
+         "ns/read", "syscalls/read");
+  RunBlocking();
+  for (int threads : kThreadCounts) {
+    RunGreen("io_uring", threads);
+  }
+  chloros::io::SetUring(false);
+  for (int threads : kThreadCounts) {
+    RunGreen("helper", threads);
+  }
+  close(file);
+  return 0;
+}
@@ -0,0 +1,147 @@
+#ifndef CHLOROS_BENCH_HARNESS_H_
+#define CHLOROS_BENCH_HARNESS_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Timing and reporting for bench/suite.cpp. A benchmark takes samples, each
+// one timing a batch of operations, and reports the cost per operation as the
+// mean over everything and as percentiles over the samples. Single operations
+// take tens of nanoseconds, about as long as reading the clock, so only whole
+// batches are timed; the percentiles show how batches vary, not how single
+// operations do.
+
+// Samples of one benchmark at one setting.
+class Sampler {
+public:
+  void Begin() { begin_ = std::chrono::steady_clock::now(); }
+
+  // End the sample begun last, which covered `ops` operations.
+  void End(long ops) {
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - begin_;
+    samples_.push_back(elapsed.count() / ops);
+    total_ns_ += elapsed.count();
+    total_ops_ += ops;
+  }
+
+  void Clear() {
+    samples_.clear();
+    total_ns_ = 0;
+    total_ops_ = 0;
+  }
+
+  std::vector<double> const& samples() const { return samples_; }
+  double total_ns() const { return total_ns_; }
+  long total_ops() const { return total_ops_; }
+
+private:
+  std::chrono::steady_clock::time_point begin_{};
+  std::vector<double> samples_{};
+  double total_ns_ = 0;
+  long total_ops_ = 0;
+}; // class Sampler
+
+struct Result {
+  std::string name;
+  // What the benchmark is swept across, like "threads", and the value.
+  std::string parameter;
+  long value;
+  long ops;
+  long samples;
+  double mean;
+  double min;
+  double p50;
+  double p90;
+  double p99;
+  double max;
+};
+
+// Collects results, printing each as a table row as it comes in, or all of
+// them as one JSON document at the end.
+class Reporter {
+public:
+  // Usage: bench_x [--json] [name...]
+  // Only benchmarks whose name is given run, or all of them if there are none.
+  Reporter(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--json") == 0) {
+        json_ = true;
+      } else {
+        filter_.push_back(argv[i]);
+      }
+    }
+    if (!json_) {
+      printf("%-18s %-14s %-12s %-10s %-10s %-10s %-10s %s\n", "benchmark",
+             "parameter", "ops", "ns/op", "p50", "p90", "p99", "max");
+    }
+  }
+
+  ~Reporter() {
+    if (!json_) {
+      return;
+    }
+    printf("{\n  \"unit\": \"ns/op\",\n  \"benchmarks\": [");
+    for (size_t i = 0; i < results_.size(); ++i) {
+      Result const& r = results_[i];
+      printf("%s\n    {\"name\": \"%s\", \"%s\": %ld, \"ops\": %ld, "
+             "\"samples\": %ld, \"mean\": %.2f, \"min\": %.2f, \"p50\": %.2f, "
+             "\"p90\": %.2f, \"p99\": %.2f, \"max\": %.2f}",
+             i == 0 ? "" : ",", r.name.c_str(), r.parameter.c_str(), r.value,
+             r.ops, r.samples, r.mean, r.min, r.p50, r.p90, r.p99, r.max);
+    }
+    printf("\n  ]\n}\n");
+  }
+
+  Reporter(Reporter const&) = delete;
+  Reporter& operator=(Reporter const&) = delete;
+
+  bool Enabled(char const* name) const {
+    return filter_.empty() ||
+           std::find(filter_.begin(), filter_.end(), name) != filter_.end();
+  }
+
+  void Report(char const* name, char const* parameter, long value,
+              Sampler const& sampler) {
+    std::vector<double> sorted = sampler.samples();
+    if (sorted.empty()) {
+      return;
+    }
+    std::sort(sorted.begin(), sorted.end());
+    // Nearest rank.
+    auto percentile = [&](double p) {
+      size_t rank = static_cast<size_t>(p * sorted.size());
+      return sorted[std::min(rank, sorted.size() - 1)];
+    };
+    Result r{name,
+             parameter,
+             value,
+             sampler.total_ops(),
+             static_cast<long>(sorted.size()),
+             sampler.total_ns() / sampler.total_ops(),
+             sorted.front(),
+             percentile(0.5),
+             percentile(0.9),
+             percentile(0.99),
+             sorted.back()};
+    results_.push_back(r);
+    if (!json_) {
+      std::string setting = r.parameter + "=" + std::to_string(r.value);
+      printf("%-18s %-14s %-12ld %-10.1f %-10.1f %-10.1f %-10.1f %.1f\n",
+             r.name.c_str(), setting.c_str(), r.ops, r.mean, r.p50, r.p90,
+             r.p99, r.max);
+      fflush(stdout);
+    }
+  }
+
+private:
+  bool json_ = false;
+  std::vector<std::string> filter_{};
+  std::vector<Result> results_{};
+}; // class Reporter
+
+#endif // CHLOROS_BENCH_HARNESS_H_
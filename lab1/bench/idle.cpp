@@ -0,0 +1,157 @@
+#include <chloros.h>
+#include <io.h>
+#include <runtime.h>
+#include <sync.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// What kernel threads with nothing to do cost, and how quickly they get going
+// again when handed something.
+//
+//   idle runtime  CPU time an idle `Runtime` with that many workers burns.
+//   idle wait     CPU time `Wait` burns on a kernel thread whose only thread
+//                 is blocked until another kernel thread wakes it up.
+//   wake latency  Time from a kernel thread outside of the runtime releasing
+//                 a semaphore to the green thread waiting for it running
+//                 again, on a worker that has nothing else to do.
+//   wake with io  The same with another thread on the worker blocked reading
+//                 a pipe, so that the worker waits in epoll rather than on
+//                 its futex.
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::chrono::milliseconds const kIdlePeriod{500};
+
+double CpuSeconds() {
+  rusage usage{};
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// Share of one core used while `idle` runs, in percent.
+template <typename F>
+double CpuPercent(F idle) {
+  double begin = CpuSeconds();
+  auto wall_begin = Clock::now();
+  idle();
+  std::chrono::duration<double> wall = Clock::now() - wall_begin;
+  return 100 * (CpuSeconds() - begin) / wall.count();
+}
+
+double IdleRuntime(size_t workers) {
+  chloros::RuntimeOptions options{};
+  options.workers = workers;
+  options.pin_workers = false;
+  chloros::Runtime runtime{options};
+  return CpuPercent([] { std::this_thread::sleep_for(kIdlePeriod); });
+}
+
+chloros::Semaphore wakeup{};
+
+void Sleeper(void*) { wakeup.Acquire(); }
+
+double IdleWait() {
+  chloros::SpawnDetached(Sleeper, nullptr);
+  // Let it block.
+  chloros::Yield();
+  std::thread waker{[] {
+    chloros::Initialize();
+    std::this_thread::sleep_for(kIdlePeriod);
+    wakeup.Release();
+    // The thread woken up runs here.
+    chloros::Wait();
+  }};
+  double percent = CpuPercent([] { chloros::Wait(); });
+  waker.join();
+  return percent;
+}
+
+constexpr int const kWakeSamples = 200;
+
+chloros::Semaphore request{};
+std::atomic<int> handled{0};
+Clock::time_point posted{};
+std::vector<double> latencies{};
+
+void Handler(void*) {
+  for (int i = 0; i < kWakeSamples; ++i) {
+    request.Acquire();
+    std::chrono::duration<double, std::micro> latency = Clock::now() - posted;
+    latencies.push_back(latency.count());
+    handled.fetch_add(1, std::memory_order_release);
+  }
+}
+
+int pipe_fds[2];
+
+void PipeReader(void*) {
+  char byte;
+  chloros::io::Read(pipe_fds[0], &byte, 1);
+}
+
+std::vector<double> WakeLatency(size_t workers, bool io) {
+  chloros::RuntimeOptions options{};
+  options.workers = workers;
+  options.pin_workers = false;
+  chloros::Runtime runtime{options};
+  latencies.clear();
+  handled.store(0, std::memory_order_relaxed);
+  if (io) {
+    if (pipe(pipe_fds) != 0) {
+      perror("pipe");
+      exit(1);
+    }
+    runtime.Spawn(PipeReader, nullptr);
+  }
+  runtime.Spawn(Handler, nullptr);
+  for (int i = 0; i < kWakeSamples; ++i) {
+    // Long enough for the workers to fall asleep.
+    std::this_thread::sleep_for(std::chrono::milliseconds{2});
+    posted = Clock::now();
+    request.Release();
+    while (handled.load(std::memory_order_acquire) == i) {
+      std::this_thread::yield();
+    }
+  }
+  if (io) {
+    if (write(pipe_fds[1], "", 1) != 1) {
+      perror("write");
+      exit(1);
+    }
+    runtime.Shutdown();
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+  }
+  std::sort(latencies.begin(), latencies.end());
+  return latencies;
+}
+
+int main() {
+  chloros::Initialize();
+  printf("%-16s %-10s %s\n", "benchmark", "workers", "cpu %");
+  for (size_t workers : {1, 2, 4}) {
+    printf("%-16s %-10zu %.2f\n", "idle runtime", workers,
+           IdleRuntime(workers));
+  }
+  printf("%-16s %-10d %.2f\n", "idle wait", 1, IdleWait());
+  printf("\n%-16s %-10s %-10s %-10s %s\n", "benchmark", "workers", "p50 us",
+         "p90 us", "p99 us");
+  for (bool io : {false, true}) {
+    for (size_t workers : {1, 2}) {
+      std::vector<double> sorted = WakeLatency(workers, io);
+      auto at = [&](double q) { return sorted[sorted.size() * q]; };
+      printf("%-16s %-10zu %-10.1f %-10.1f %.1f\n",
+             io ? "wake with io" : "wake latency", workers, at(0.5), at(0.9),
+             at(0.99));
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,123 @@
+#include <chloros.h>
+#include <sync.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Latency of handing a contended lock from one thread to the next, for
+// `chloros::Mutex` between green threads and `std::mutex` between kernel
+// threads. Every thread yields while holding the lock, so every acquisition
+// after the first one finds it taken and has to wait for a handoff. Also
+// measures a ping-pong between two threads through a pair of semaphores, and
+// the same with a mutex and condition variable between kernel threads.
+
+constexpr int const kThreads = 8;
+constexpr int const kIterations = 100000;
+
+template <typename Mutex>
+struct Shared {
+  Mutex mutex{};
+  long counter = 0;
+};
+
+Shared<chloros::Mutex> green{};
+Shared<std::mutex> native{};
+
+void GreenLocker(void*) {
+  for (int i = 0; i < kIterations; ++i) {
+    std::lock_guard<chloros::Mutex> lock{green.mutex};
+    ++green.counter;
+    chloros::Yield();
+  }
+}
+
+void NativeLocker() {
+  for (int i = 0; i < kIterations; ++i) {
+    std::lock_guard<std::mutex> lock{native.mutex};
+    ++native.counter;
+    std::this_thread::yield();
+  }
+}
+
+chloros::Semaphore ping{0};
+chloros::Semaphore pong{0};
+
+void Ponger(void*) {
+  for (int i = 0; i < kIterations; ++i) {
+    ping.Acquire();
+    pong.Release();
+  }
+}
+
+std::mutex native_ping_mutex{};
+std::condition_variable native_ping{};
+bool native_turn = false;
+
+void NativePonger() {
+  for (int i = 0; i < kIterations; ++i) {
+    std::unique_lock<std::mutex> lock{native_ping_mutex};
+    native_ping.wait(lock, [] { return native_turn; });
+    native_turn = false;
+    native_ping.notify_one();
+  }
+}
+
+template <typename F>
+double NanosPer(long ops, F f) {
+  auto begin = std::chrono::steady_clock::now();
+  f();
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  return elapsed.count() / ops;
+}
+
+int main() {
+  chloros::Initialize();
+  long handoffs = static_cast<long>(kThreads) * kIterations;
+  printf("%-34s %s\n", "benchmark", "ns/op");
+
+  double ns = NanosPer(handoffs, [] {
+    for (int i = 0; i < kThreads; ++i) {
+      chloros::SpawnDetached(GreenLocker, nullptr);
+    }
+    chloros::Wait();
+  });
+  printf("%-34s %.1f\n", "chloros::Mutex handoff", ns);
+
+  ns = NanosPer(handoffs, [] {
+    std::vector<std::thread> threads{};
+    for (int i = 0; i < kThreads; ++i) {
+      threads.emplace_back(NativeLocker);
+    }
+    for (auto&& thread : threads) {
+      thread.join();
+    }
+  });
+  printf("%-34s %.1f\n", "std::mutex handoff", ns);
+
+  ns = NanosPer(kIterations, [] {
+    chloros::SpawnDetached(Ponger, nullptr);
+    for (int i = 0; i < kIterations; ++i) {
+      ping.Release();
+      pong.Acquire();
+    }
+    chloros::Wait();
+  });
+  printf("%-34s %.1f\n", "chloros::Semaphore ping-pong", ns);
+
+  ns = NanosPer(kIterations, [] {
+    std::thread ponger{NativePonger};
+    for (int i = 0; i < kIterations; ++i) {
+      std::unique_lock<std::mutex> lock{native_ping_mutex};
+      native_turn = true;
+      native_ping.notify_one();
+      native_ping.wait(lock, [] { return !native_turn; });
+    }
+    ponger.join();
+  });
+  printf("%-34s %.1f\n", "std::condition_variable ping-pong", ns);
+  return 0;
+}
@@ -0,0 +1,100 @@
+#include <chloros.h>
+#include <parallel.h>
+#include <runtime.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+// What `ParallelReduce` costs and gains over a plain loop on a `Runtime`, for
+// a CPU-bound batch job: adding up the hashes of every index of a range. The
+// loop runs in a green thread on one of the workers, the way a batch job
+// would, and every run is timed from there, best of a few. With one worker,
+// or one core, there is nobody to split for, so the difference is what lazy
+// splitting costs when it does not pay off.
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint64_t const kSize = 1 << 22;
+constexpr int const kRuns = 5;
+
+// The finalizer of MurmurHash3.
+inline uint64_t Hash(uint64_t x) {
+  // Keeps loops over it from being vectorized, which takes emulated 64-bit
+  // multiplies without AVX-512, so that every variant does the same work.
+  asm("" : "+r"(x));
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdu;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53u;
+  x ^= x >> 33;
+  return x;
+}
+
+uint64_t Sequential() {
+  uint64_t sum = 0;
+  for (uint64_t i = 0; i < kSize; ++i) {
+    sum += Hash(i);
+  }
+  return sum;
+}
+
+uint64_t Parallel(size_t grain) {
+  return chloros::ParallelReduce(
+      uint64_t{0}, kSize, grain, uint64_t{0},
+      [](uint64_t i) { return Hash(i); },
+      [](uint64_t a, uint64_t b) { return a + b; });
+}
+
+struct Job {
+  size_t grain;  // Zero for the plain loop.
+  double ms;
+  uint64_t spawns;
+  uint64_t sum;
+};
+
+void Run(void *arg) {
+  auto job = static_cast<Job *>(arg);
+  job->ms = 1e300;
+  uint64_t spawns_before = chloros::GetSchedulerStats().total.spawns;
+  for (int run = 0; run < kRuns; ++run) {
+    auto begin = Clock::now();
+    job->sum = job->grain == 0 ? Sequential() : Parallel(job->grain);
+    std::chrono::duration<double, std::milli> elapsed = Clock::now() - begin;
+    job->ms = std::min(job->ms, elapsed.count());
+  }
+  job->spawns =
+      (chloros::GetSchedulerStats().total.spawns - spawns_before) / kRuns;
+}
+
+Job Measure(size_t workers, size_t grain) {
+  chloros::RuntimeOptions options{};
+  options.workers = workers;
+  chloros::Runtime runtime{options};
+  Job job{grain, 0, 0, 0};
+  runtime.Spawn(Run, &job);
+  runtime.Shutdown();
+  return job;
+}
+
+int main() {
+  chloros::Initialize();
+  size_t cores = std::max(1u, std::thread::hardware_concurrency());
+  printf("%-10s %-10s %-10s %-10s %-10s %s\n", "workers", "grain", "ms",
+         "speedup", "spawns", "checksum");
+  for (size_t workers : {size_t{1}, size_t{2}, size_t{4}, cores}) {
+    Job base = Measure(workers, 0);
+    printf("%-10zu %-10s %-10.2f %-10.2f %-10s %016llx\n", workers, "loop",
+           base.ms, 1.0, "-", static_cast<unsigned long long>(base.sum));
+    for (size_t grain : {1, 64, 4096}) {
+      Job job = Measure(workers, grain);
+      printf("%-10zu %-10zu %-10.2f %-10.2f %-10llu %016llx\n", workers, grain,
+             job.ms, base.ms / job.ms,
+             static_cast<unsigned long long>(job.spawns),
+             static_cast<unsigned long long>(job.sum));
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,135 @@
+#include "harness.h"
+#include <chloros.h>
+#include <sync.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+// What the scheduling policy the library was built with costs, and what it
+// does for a latency-sensitive thread. Built once per policy, as
+// bench_policy_<policy>.
+//
+//   <policy>.yield    `Yield` with that many threads ready, per switch.
+//   <policy>.latency  Time from a request being posted to the handler
+//                     thread running, with the handler at that priority,
+//                     while CPU-bound threads at the default priority keep
+//                     every kernel thread busy. They run for a while between
+//                     yields, and so does the client that posts requests.
+//
+// Usage: bench_policy_<policy> [--json] [benchmark...]
+
+using Clock = std::chrono::steady_clock;
+
+chloros::SpawnOptions const kSmallStack{1 << 14, false};
+
+bool stop = false;
+
+// Yielding threads, see bench/yield.cpp. The initial thread is one of them.
+void YieldLoop(void* arg) {
+  long remaining = reinterpret_cast<long>(arg);
+  if (remaining > 1) {
+    chloros::Spawn(YieldLoop, reinterpret_cast<void*>(remaining - 1),
+                   kSmallStack);
+  }
+  while (!stop) {
+    chloros::Yield();
+  }
+}
+
+void YieldBench(Reporter& reporter, std::string const& name) {
+  constexpr int const kSamples = 200;
+  constexpr long const kSwitchesPerSample = 10000;
+  for (long threads : {2, 256}) {
+    stop = false;
+    chloros::Spawn(YieldLoop, reinterpret_cast<void*>(threads - 1),
+                   kSmallStack);
+    long rounds = std::max(1L, kSwitchesPerSample / threads);
+    Sampler sampler{};
+    for (int i = 0; i < kSamples; ++i) {
+      sampler.Begin();
+      for (long j = 0; j < rounds; ++j) {
+        chloros::Yield();
+      }
+      // Every policy puts threads that yield at the back of their level.
+      sampler.End(rounds * threads);
+    }
+    stop = true;
+    chloros::Wait();
+    reporter.Report(name.c_str(), "threads", threads, sampler);
+  }
+}
+
+constexpr int const kHogs = 32;
+constexpr int const kRequests = 200;
+constexpr std::chrono::microseconds const kChunk{50};
+
+chloros::Semaphore requests{};
+Sampler latency{};
+int posted = 0;
+int handled = 0;
+
+void Spin() {
+  Clock::time_point until = Clock::now() + kChunk;
+  while (Clock::now() < until) {
+  }
+}
+
+void Hog(void*) {
+  while (!stop) {
+    Spin();
+    chloros::Yield();
+  }
+}
+
+// Posts a request whenever the last one was handled.
+void Client(void*) {
+  while (!stop) {
+    Spin();
+    if (posted == handled) {
+      ++posted;
+      latency.Begin();
+      requests.Release();
+    }
+    chloros::Yield();
+  }
+}
+
+void Handler(void*) {
+  for (int i = 0; i < kRequests; ++i) {
+    requests.Acquire();
+    latency.End(1);
+    ++handled;
+  }
+  stop = true;
+}
+
+void LatencyBench(Reporter& reporter, std::string const& name) {
+  for (int priority : {chloros::kDefaultPriority, chloros::kPriorityLevels - 1}) {
+    stop = false;
+    posted = 0;
+    handled = 0;
+    latency.Clear();
+    chloros::SpawnOptions options = kSmallStack;
+    options.priority = priority;
+    chloros::SpawnDetached(Handler, nullptr, options);
+    for (int i = 0; i < kHogs; ++i) {
+      chloros::SpawnDetached(Hog, nullptr, kSmallStack);
+    }
+    chloros::SpawnDetached(Client, nullptr, kSmallStack);
+    chloros::Wait();
+    reporter.Report(name.c_str(), "priority", priority, latency);
+  }
+}
+
+int main(int argc, char** argv) {
+  Reporter reporter{argc, argv};
+  chloros::Initialize();
+  std::string policy = chloros::GetSchedulingPolicy();
+  if (reporter.Enabled("yield")) {
+    YieldBench(reporter, policy + ".yield");
+  }
+  if (reporter.Enabled("latency")) {
+    LatencyBench(reporter, policy + ".latency");
+  }
+  return 0;
+}
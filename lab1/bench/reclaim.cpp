@@ -0,0 +1,62 @@
+#include <chloros.h>
+#include <chrono>
+#include <cstdio>
+
+// Cost of a context switch among 10k live green threads while short-lived
+// threads keep exiting in between. Every round, the initial thread spawns a
+// few threads that exit as soon as they run, and yields once; the round then
+// goes through every live thread and every exiting one. Reclaiming an exited
+// thread must not touch the live ones, so the cost per switch should stay flat
+// however many threads exit per round.
+
+constexpr long const kLiveThreads = 10000;
+constexpr long const kSwitchesPerRun = 2000000;
+constexpr long const kExitsPerRound[] = {0, 1, 10, 100, 1000};
+
+bool stop = false;
+
+chloros::SpawnOptions const kOptions{1 << 14, false};
+
+// Each thread spawns the next one before it starts yielding, see
+// bench/yield.cpp.
+void YieldLoop(void* arg) {
+  long remaining = reinterpret_cast<long>(arg);
+  if (remaining > 1) {
+    chloros::Spawn(YieldLoop, reinterpret_cast<void*>(remaining - 1),
+                   kOptions);
+  }
+  while (!stop) {
+    chloros::Yield();
+  }
+}
+
+void Exit(void*) {}
+
+double Run(long exits) {
+  long rounds = kSwitchesPerRun / (kLiveThreads + 1 + exits);
+  auto begin = std::chrono::steady_clock::now();
+  for (long i = 0; i < rounds; ++i) {
+    for (long j = 0; j < exits; ++j) {
+      chloros::SpawnDetached(Exit, nullptr, kOptions);
+    }
+    chloros::Yield();
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  return elapsed.count() / (rounds * (kLiveThreads + 1 + exits));
+}
+
+int main() {
+  chloros::Initialize();
+  chloros::Spawn(YieldLoop, reinterpret_cast<void*>(kLiveThreads), kOptions);
+  // Warm up the stack cache and the caches of the CPU.
+  Run(10);
+  printf("%-12s %-16s %s\n", "live", "exits/round", "ns/switch");
+  for (long exits : kExitsPerRound) {
+    printf("%-12ld %-16ld %.1f\n", kLiveThreads, exits, Run(exits));
+    fflush(stdout);
+  }
+  stop = true;
+  chloros::Wait();
+  return 0;
+}
@@ -0,0 +1,62 @@
+#include <chloros.h>
+#include <runtime.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+// Throughput of a CPU-bound workload on a `Runtime` as the number of workers
+// grows. All green threads are spawned from the main thread, which is not a
+// worker, and yield every so often, so stealing gets to move them around. The
+// total should scale with the number of cores until we run out of them.
+
+constexpr int const kGreenThreads = 256;
+constexpr int const kChunksPerGreenThread = 200;
+constexpr int const kIterationsPerChunk = 5000;
+
+volatile uint64_t sink = 0;
+
+void Crunch(void*) {
+  uint64_t x = 88172645463325252ull;
+  for (int i = 0; i < kChunksPerGreenThread; ++i) {
+    for (int j = 0; j < kIterationsPerChunk; ++j) {
+      x ^= x << 13;
+      x ^= x >> 7;
+      x ^= x << 17;
+    }
+    chloros::Yield();
+  }
+  sink = x;
+}
+
+double Run(size_t workers) {
+  chloros::RuntimeOptions options{};
+  options.workers = workers;
+  chloros::Runtime runtime{options};
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < kGreenThreads; ++i) {
+    runtime.Spawn(Crunch, nullptr);
+  }
+  runtime.Shutdown();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  return elapsed.count();
+}
+
+int main() {
+  unsigned cores = std::thread::hardware_concurrency();
+  printf("%-16s %-12s %-16s %s\n", "workers", "seconds", "chunks/s",
+         "speedup");
+  double base = 0;
+  for (unsigned n = 1; n <= 2 * cores; n *= 2) {
+    double seconds = Run(n);
+    double rate =
+        static_cast<double>(kGreenThreads) * kChunksPerGreenThread / seconds;
+    if (n == 1) {
+      base = rate;
+    }
+    printf("%-16u %-12.3f %-16.0f %.2fx%s\n", n, seconds, rate, rate / base,
+           n > cores ? " (oversubscribed)" : "");
+  }
+  return 0;
+}
@@ -0,0 +1,56 @@
+#include <chloros.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Round trip cost of spawning a green thread that exits right away, with and
+// without the stack cache. Also counts calls into malloc per spawn, which
+// should be zero in steady state when stacks and control blocks are recycled.
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+
+std::atomic<long> allocations{0};
+
+void* malloc(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_memalign(alignment, size);
+}
+}
+
+constexpr int const kWarmup = 1000;
+constexpr int const kSpawns = 200000;
+
+void Noop(void*) {}
+
+void Run(char const* name, size_t cache_limit) {
+  chloros::SetStackCacheLimit(cache_limit);
+  for (int i = 0; i < kWarmup; ++i) {
+    chloros::Spawn(Noop, nullptr);
+  }
+  allocations = 0;
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < kSpawns; ++i) {
+    chloros::Spawn(Noop, nullptr);
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  printf("%-16s %-16.1f %.3f\n", name, elapsed.count() / kSpawns,
+         static_cast<double>(allocations) / kSpawns);
+}
+
+int main() {
+  chloros::Initialize();
+  printf("%-16s %-16s %s\n", "stack_cache", "ns/spawn+exit", "mallocs/spawn");
+  Run("disabled", 0);
+  Run("enabled", 16);
+  return 0;
+}
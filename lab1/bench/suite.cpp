@@ -0,0 +1,426 @@
+#include "harness.h"
+#include <chloros.h>
+#include <fiber_local.h>
+#include <runtime.h>
+#include <sync.h>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <ucontext.h>
+#include <unordered_map>
+#include <vector>
+
+// The scheduler's basic operations, each swept across the number of threads
+// involved, next to what they compare with outside of the library:
+//
+//   context_switch  `context_switch` between two hand-made contexts.
+//   swapcontext     The same with ucontext, which also saves the signal mask.
+//   yield           `Yield` with that many threads ready, per switch.
+//   traced_yield    The same with the tracer on, which records every switch.
+//   yield_to        Two threads switching to each other with `YieldTo`,
+//                   past the others of that many ready ones, per switch.
+//   spawn_exit      `Spawn` of a thread that exits right away, with that many
+//                   other threads blocked.
+//   spawn_closure   The same with a lambda that captures that many bytes,
+//                   kept on the new thread's stack, and nothing blocked.
+//   std_thread      Creating and joining a kernel thread.
+//   wait_drain      `Wait` for that many threads that were just spawned, per
+//                   thread.
+//   handoff         Two threads on a `Runtime` with that many workers waking
+//                   each other up through semaphores, per wakeup. They are
+//                   spawned onto different workers, but may be stolen onto
+//                   the same one.
+//   fiber_local     `FiberLocal::get` of a value that exists.
+//   locked_map      The same through a map keyed by thread id behind a
+//                   mutex, with values for that many threads in it.
+//
+// Usage: bench_suite [--json] [benchmark...]
+// With --json, the results go to stdout as one JSON document, for comparing
+// against an earlier run.
+
+extern "C" void ContextSwitch(chloros::Context* old_context,
+                              chloros::Context* new_context)
+    __asm__("context_switch");
+
+// Warm-up samples that are not reported.
+constexpr int const kWarmupSamples = 10;
+
+chloros::SpawnOptions const kSmallStack{1 << 14, false};
+
+// Raw context switches: the initial thread and a bouncer on a stack of its own
+// switch back and forth.
+chloros::Context main_context{};
+chloros::Context bouncer_context{};
+
+[[noreturn]] void Bounce() {
+  for (;;) {
+    ContextSwitch(&bouncer_context, &main_context);
+  }
+}
+
+void ContextSwitchBench(Reporter& reporter) {
+  constexpr int const kSamples = 1000;
+  constexpr long const kRoundTrips = 1000;
+  std::vector<uint8_t> stack(1 << 16);
+  // `ret` into `Bounce` leaves the stack as a call would, 8 bytes off 16.
+  auto top = reinterpret_cast<uintptr_t>(stack.data() + stack.size()) &
+             ~uintptr_t{15};
+  auto rsp = reinterpret_cast<void**>(top - 16);
+  *rsp = reinterpret_cast<void*>(Bounce);
+  bouncer_context.rsp = reinterpret_cast<uint64_t>(rsp);
+  bouncer_context.mxcsr = 0x1F80;
+  bouncer_context.x87 = 0x037F;
+  Sampler sampler{};
+  for (int i = 0; i < kWarmupSamples + kSamples; ++i) {
+    if (i == kWarmupSamples) {
+      sampler.Clear();
+    }
+    sampler.Begin();
+    for (long j = 0; j < kRoundTrips; ++j) {
+      ContextSwitch(&main_context, &bouncer_context);
+    }
+    sampler.End(2 * kRoundTrips);
+  }
+  reporter.Report("context_switch", "threads", 2, sampler);
+}
+
+ucontext_t main_ucontext{};
+ucontext_t bouncer_ucontext{};
+
+void BounceUcontext() {
+  for (;;) {
+    swapcontext(&bouncer_ucontext, &main_ucontext);
+  }
+}
+
+void SwapcontextBench(Reporter& reporter) {
+  constexpr int const kSamples = 1000;
+  constexpr long const kRoundTrips = 100;
+  std::vector<uint8_t> stack(1 << 16);
+  getcontext(&bouncer_ucontext);
+  bouncer_ucontext.uc_stack.ss_sp = stack.data();
+  bouncer_ucontext.uc_stack.ss_size = stack.size();
+  bouncer_ucontext.uc_link = nullptr;
+  makecontext(&bouncer_ucontext, BounceUcontext, 0);
+  Sampler sampler{};
+  for (int i = 0; i < kWarmupSamples + kSamples; ++i) {
+    if (i == kWarmupSamples) {
+      sampler.Clear();
+    }
+    sampler.Begin();
+    for (long j = 0; j < kRoundTrips; ++j) {
+      swapcontext(&main_ucontext, &bouncer_ucontext);
+    }
+    sampler.End(2 * kRoundTrips);
+  }
+  reporter.Report("swapcontext", "threads", 2, sampler);
+}
+
+// Yielding threads, see bench/yield.cpp. The initial thread is one of them.
+bool stop_yielding = false;
+
+void YieldLoop(void* arg) {
+  long remaining = reinterpret_cast<long>(arg);
+  if (remaining > 1) {
+    chloros::Spawn(YieldLoop, reinterpret_cast<void*>(remaining - 1),
+                   kSmallStack);
+  }
+  while (!stop_yielding) {
+    chloros::Yield();
+  }
+}
+
+void YieldSweep(Reporter& reporter, char const* name) {
+  constexpr int const kSamples = 200;
+  constexpr long const kSwitchesPerSample = 10000;
+  for (long threads : {2, 16, 256, 4096, 65536}) {
+    stop_yielding = false;
+    chloros::Spawn(YieldLoop, reinterpret_cast<void*>(threads - 1),
+                   kSmallStack);
+    // Every yield of the initial thread is a round of all threads.
+    long rounds = std::max(1L, kSwitchesPerSample / threads);
+    Sampler sampler{};
+    for (int i = 0; i < kWarmupSamples + kSamples; ++i) {
+      if (i == kWarmupSamples) {
+        sampler.Clear();
+      }
+      sampler.Begin();
+      for (long j = 0; j < rounds; ++j) {
+        chloros::Yield();
+      }
+      sampler.End(rounds * threads);
+    }
+    stop_yielding = true;
+    chloros::Wait();
+    reporter.Report(name, "threads", threads, sampler);
+  }
+}
+
+void YieldBench(Reporter& reporter) { YieldSweep(reporter, "yield"); }
+
+void TracedYieldBench(Reporter& reporter) {
+  chloros::SetTracing(true);
+  YieldSweep(reporter, "traced_yield");
+  chloros::SetTracing(false);
+}
+
+// The partner of the initial thread in the yield_to benchmark.
+bool stop_yielding_to = false;
+
+void YieldToInitial(void* arg) {
+  auto initial = static_cast<chloros::Thread*>(arg);
+  while (!stop_yielding_to) {
+    if (!chloros::YieldTo(initial)) {
+      chloros::Yield();
+    }
+  }
+}
+
+void YieldToBench(Reporter& reporter) {
+  constexpr int const kSamples = 200;
+  constexpr long const kRoundTripsPerSample = 5000;
+  for (long threads : {2, 256, 4096}) {
+    stop_yielding = false;
+    stop_yielding_to = false;
+    if (threads > 2) {
+      chloros::Spawn(YieldLoop, reinterpret_cast<void*>(threads - 2),
+                     kSmallStack);
+    }
+    chloros::JoinHandle partner = chloros::Spawn(
+        YieldToInitial, chloros::CurrentThread(), kSmallStack);
+    Sampler sampler{};
+    for (int i = 0; i < kWarmupSamples + kSamples; ++i) {
+      if (i == kWarmupSamples) {
+        sampler.Clear();
+      }
+      sampler.Begin();
+      for (long j = 0; j < kRoundTripsPerSample; ++j) {
+        chloros::YieldTo(partner);
+      }
+      sampler.End(2 * kRoundTripsPerSample);
+    }
+    stop_yielding = true;
+    stop_yielding_to = true;
+    chloros::Wait();
+    reporter.Report("yield_to", "threads", threads, sampler);
+  }
+}
+
+// Blocked threads stay out of the way of the spawns.
+chloros::Semaphore blocked_release{};
+
+void Block(void*) { blocked_release.Acquire(); }
+
+void Noop(void*) {}
+
+void SpawnExitBench(Reporter& reporter) {
+  constexpr int const kSamples = 500;
+  constexpr long const kSpawnsPerSample = 200;
+  for (long blocked : {0, 1000, 100000}) {
+    std::vector<void*> args(blocked);
+    chloros::SpawnMany(Block, args.data(), blocked, kSmallStack);
+    // Let them block.
+    chloros::Yield();
+    Sampler sampler{};
+    for (int i = 0; i < kWarmupSamples + kSamples; ++i) {
+      if (i == kWarmupSamples) {
+        sampler.Clear();
+      }
+      sampler.Begin();
+      for (long j = 0; j < kSpawnsPerSample; ++j) {
+        chloros::Spawn(Noop, nullptr, kSmallStack);
+      }
+      sampler.End(kSpawnsPerSample);
+    }
+    blocked_release.Release(blocked);
+    chloros::Wait();
+    reporter.Report("spawn_exit", "blocked", blocked, sampler);
+  }
+}
+
+template <size_t kBytes>
+void SpawnClosureSetting(Reporter& reporter) {
+  constexpr int const kSamples = 500;
+  constexpr long const kSpawnsPerSample = 200;
+  std::array<char, kBytes> capture{};
+  Sampler sampler{};
+  for (int i = 0; i < kWarmupSamples + kSamples; ++i) {
+    if (i == kWarmupSamples) {
+      sampler.Clear();
+    }
+    sampler.Begin();
+    for (long j = 0; j < kSpawnsPerSample; ++j) {
+      chloros::Spawn(kSmallStack, [capture] { (void)capture; });
+    }
+    sampler.End(kSpawnsPerSample);
+  }
+  reporter.Report("spawn_closure", "bytes", kBytes, sampler);
+}
+
+void SpawnClosureBench(Reporter& reporter) {
+  SpawnClosureSetting<8>(reporter);
+  SpawnClosureSetting<64>(reporter);
+  SpawnClosureSetting<512>(reporter);
+}
+
+void StdThreadBench(Reporter& reporter) {
+  constexpr int const kSamples = 100;
+  constexpr long const kThreadsPerSample = 20;
+  Sampler sampler{};
+  for (int i = 0; i < kWarmupSamples + kSamples; ++i) {
+    if (i == kWarmupSamples) {
+      sampler.Clear();
+    }
+    sampler.Begin();
+    for (long j = 0; j < kThreadsPerSample; ++j) {
+      std::thread{[] {}}.join();
+    }
+    sampler.End(kThreadsPerSample);
+  }
+  reporter.Report("std_thread", "threads", 1, sampler);
+}
+
+void WaitDrainBench(Reporter& reporter) {
+  constexpr long const kThreadsPerSetting = 1000000;
+  for (long threads : {16, 256, 4096, 65536}) {
+    std::vector<void*> args(threads);
+    long samples = std::min(1000L, std::max(10L, kThreadsPerSetting / threads));
+    Sampler sampler{};
+    for (int i = 0; i < kWarmupSamples + samples; ++i) {
+      if (i == kWarmupSamples) {
+        sampler.Clear();
+      }
+      chloros::SpawnMany(Noop, args.data(), threads, kSmallStack);
+      sampler.Begin();
+      chloros::Wait();
+      sampler.End(threads);
+    }
+    reporter.Report("wait_drain", "threads", threads, sampler);
+  }
+}
+
+// Ping-pong between two green threads on a runtime. The pinger times it.
+constexpr int const kHandoffSamples = 50;
+constexpr long const kHandoffRoundTrips = 20;
+chloros::Semaphore ping{};
+chloros::Semaphore pong{};
+Sampler handoff_sampler{};
+
+void Pinger(void*) {
+  for (int i = 0; i < kWarmupSamples + kHandoffSamples; ++i) {
+    if (i == kWarmupSamples) {
+      handoff_sampler.Clear();
+    }
+    handoff_sampler.Begin();
+    for (long j = 0; j < kHandoffRoundTrips; ++j) {
+      ping.Release();
+      pong.Acquire();
+    }
+    handoff_sampler.End(2 * kHandoffRoundTrips);
+  }
+}
+
+void Ponger(void*) {
+  for (long i = 0; i < (kWarmupSamples + kHandoffSamples) * kHandoffRoundTrips;
+       ++i) {
+    ping.Acquire();
+    pong.Release();
+  }
+}
+
+void HandoffBench(Reporter& reporter) {
+  for (size_t workers : {1, 2, 4}) {
+    chloros::RuntimeOptions options{};
+    options.workers = workers;
+    options.pin_workers = false;
+    chloros::Runtime runtime{options};
+    // Threads spawned from outside go round-robin.
+    runtime.Spawn(Ponger, nullptr, kSmallStack);
+    runtime.Spawn(Pinger, nullptr, kSmallStack);
+    runtime.Shutdown();
+    reporter.Report("handoff", "workers", static_cast<long>(workers),
+                    handoff_sampler);
+  }
+}
+
+// Per-thread values, found the fast way and the obvious way.
+constexpr int const kLookupSamples = 200;
+constexpr long const kLookupsPerSample = 10000;
+
+volatile long lookup_sink = 0;
+
+void FiberLocalBench(Reporter& reporter) {
+  chloros::FiberLocal<long> local{};
+  *local = 1;
+  Sampler sampler{};
+  for (int i = 0; i < kWarmupSamples + kLookupSamples; ++i) {
+    if (i == kWarmupSamples) {
+      sampler.Clear();
+    }
+    sampler.Begin();
+    long sum = 0;
+    for (long j = 0; j < kLookupsPerSample; ++j) {
+      sum += local.get();
+    }
+    lookup_sink = sum;
+    sampler.End(kLookupsPerSample);
+  }
+  reporter.Report("fiber_local", "threads", 1, sampler);
+}
+
+void LockedMapBench(Reporter& reporter) {
+  for (long threads : {1, 1000, 100000}) {
+    std::mutex mutex{};
+    std::unordered_map<uint64_t, long> values{};
+    uint64_t self = chloros::CurrentThread()->id;
+    for (long i = 0; i < threads; ++i) {
+      values[self + i] = 1;
+    }
+    Sampler sampler{};
+    for (int i = 0; i < kWarmupSamples + kLookupSamples; ++i) {
+      if (i == kWarmupSamples) {
+        sampler.Clear();
+      }
+      sampler.Begin();
+      long sum = 0;
+      for (long j = 0; j < kLookupsPerSample; ++j) {
+        std::lock_guard<std::mutex> lock{mutex};
+        sum += values[chloros::CurrentThread()->id];
+      }
+      lookup_sink = sum;
+      sampler.End(kLookupsPerSample);
+    }
+    reporter.Report("locked_map", "threads", threads, sampler);
+  }
+}
+
+int main(int argc, char** argv) {
+  Reporter reporter{argc, argv};
+  chloros::Initialize();
+  struct {
+    char const* name;
+    void (*run)(Reporter&);
+  } const benchmarks[] = {
+      {"context_switch", ContextSwitchBench},
+      {"swapcontext", SwapcontextBench},
+      {"yield", YieldBench},
+      {"traced_yield", TracedYieldBench},
+      {"yield_to", YieldToBench},
+      {"spawn_exit", SpawnExitBench},
+      {"spawn_closure", SpawnClosureBench},
+      {"std_thread", StdThreadBench},
+      {"wait_drain", WaitDrainBench},
+      {"handoff", HandoffBench},
+      {"fiber_local", FiberLocalBench},
+      {"locked_map", LockedMapBench},
+  };
+  for (auto const& benchmark : benchmarks) {
+    if (reporter.Enabled(benchmark.name)) {
+      benchmark.run(reporter);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,75 @@
+#include <chloros.h>
+#include <chrono>
+#include <cstdio>
+
+// Cost of a context switch between two threads that yield to each other, for
+// plain threads and for threads spawned with `SpawnOptions::vector_state`. A
+// thread either leaves the vector registers alone, or writes to the upper
+// halves of %ymm8 or to %zmm16 between yields, which is what `xsaveopt` then
+// has to save. Plain threads never save them, whatever they hold, though dirty
+// upper halves of %ymm registers slow down the SSE code of the scheduler.
+
+constexpr long const kYields = 1000000;
+
+enum class Registers { kNone, kYmm, kZmm };
+
+Registers dirty = Registers::kNone;
+
+void Touch(long i) {
+  switch (dirty) {
+  case Registers::kNone:
+    break;
+  case Registers::kYmm:
+    __asm__ volatile("vpbroadcastq %0, %%ymm8" : : "m"(i) : "xmm8");
+    break;
+  case Registers::kZmm:
+    // The compiler does not use %zmm16 without -mavx512f, nor knows about it.
+    __asm__ volatile("vpbroadcastq %0, %%zmm16" : : "m"(i));
+    break;
+  }
+}
+
+void YieldLoop(void*) {
+  for (long i = 0; i < kYields; ++i) {
+    Touch(i);
+    chloros::Yield();
+  }
+}
+
+double Run(bool vector_state) {
+  chloros::SpawnOptions options{};
+  options.stack_size = 1 << 14;
+  options.guard_page = false;
+  options.vector_state = vector_state;
+  auto begin = std::chrono::steady_clock::now();
+  chloros::Spawn(YieldLoop, nullptr, options);
+  chloros::Spawn(YieldLoop, nullptr, options);
+  chloros::Wait();
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  return elapsed.count() / (2 * kYields);
+}
+
+void Report(char const* registers, Registers kind) {
+  dirty = kind;
+  double plain = Run(false);
+  double vector = Run(true);
+  printf("%-10s %-12.1f %.1f\n", registers, plain, vector);
+  fflush(stdout);
+}
+
+int main() {
+  chloros::Initialize();
+  // Warm up the stack cache and the caches of the CPU.
+  Run(false);
+  Run(true);
+  printf("%-10s %-12s %s\n", "dirty", "plain ns", "vector ns");
+  Report("none", Registers::kNone);
+  if (__builtin_cpu_supports("avx2")) {
+    Report("ymm", Registers::kYmm);
+  }
+  if (__builtin_cpu_supports("avx512f")) {
+    Report("zmm", Registers::kZmm);
+  }
+  return 0;
+}
@@ -0,0 +1,64 @@
+#include <chloros.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+// Cost of a single `Yield` as the number of live green threads grows. All
+// threads are ready and yield in a loop, so every yield has to pick the next
+// thread and put the current one back; with constant time run queue
+// operations the cost per yield should stay flat. Past the size of the caches
+// it grows a little from touching a cold stack and control block per switch.
+// Threads get small stacks without guard pages, so that a million of them fit
+// in a few GB and a handful of memory mappings.
+//
+// Usage: bench_yield [max_threads]
+
+constexpr long const kYieldsPerRun = 2000000;
+
+bool stop = false;
+
+chloros::SpawnOptions const kOptions{1 << 14, false};
+
+// Each thread spawns the next one before it starts yielding. Spawning them all
+// from the initial thread instead would make every new thread wait for a full
+// round of the existing ones, which is quadratic in the number of threads.
+void YieldLoop(void* arg) {
+  long remaining = reinterpret_cast<long>(arg);
+  if (remaining > 1) {
+    chloros::Spawn(YieldLoop, reinterpret_cast<void*>(remaining - 1),
+                   kOptions);
+  }
+  while (!stop) {
+    chloros::Yield();
+  }
+}
+
+double Run(long threads) {
+  stop = false;
+  chloros::Spawn(YieldLoop, reinterpret_cast<void*>(threads), kOptions);
+  // Every round of the initial thread is one yield by each thread.
+  long rounds = kYieldsPerRun / (threads + 1);
+  if (rounds == 0) {
+    rounds = 1;
+  }
+  auto begin = std::chrono::steady_clock::now();
+  for (long i = 0; i < rounds; ++i) {
+    chloros::Yield();
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  stop = true;
+  chloros::Wait();
+  return elapsed.count() / (rounds * (threads + 1));
+}
+
+int main(int argc, char** argv) {
+  long max_threads = argc > 1 ? std::atol(argv[1]) : 100000;
+  chloros::Initialize();
+  printf("%-12s %s\n", "threads", "ns/yield");
+  for (long n = 10; n <= max_threads; n *= 10) {
+    printf("%-12ld %.1f\n", n, Run(n));
+    fflush(stdout);
+  }
+  return 0;
+}
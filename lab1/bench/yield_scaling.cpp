@@ -0,0 +1,68 @@
+#include <chloros.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Aggregate yield throughput as the number of kernel threads grows. Every
+// kernel thread runs the same number of green threads that yield in a loop, so
+// with per-kernel-thread run queues the total should scale with the number of
+// cores until we run out of them.
+
+constexpr int const kGreenThreadsPerKernelThread = 4;
+constexpr int const kYieldsPerGreenThread = 200000;
+constexpr int const kMaxKernelThreads = 16;
+
+std::atomic<bool> start{false};
+
+void YieldLoop(void*) {
+  for (int i = 0; i < kYieldsPerGreenThread; ++i) {
+    chloros::Yield();
+  }
+}
+
+void KernelThreadWorker() {
+  chloros::Initialize();
+  while (!start.load(std::memory_order_acquire)) {
+    std::this_thread::yield();
+  }
+  for (int i = 0; i < kGreenThreadsPerKernelThread; ++i) {
+    chloros::Spawn(YieldLoop, nullptr);
+  }
+  chloros::Wait();
+}
+
+double Run(int kernel_threads) {
+  start = false;
+  std::vector<std::thread> threads{};
+  for (int i = 0; i < kernel_threads; ++i) {
+    threads.emplace_back(KernelThreadWorker);
+  }
+  auto begin = std::chrono::steady_clock::now();
+  start = true;
+  for (auto&& thread : threads) {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  return elapsed.count();
+}
+
+int main() {
+  unsigned cores = std::thread::hardware_concurrency();
+  printf("%-16s %-12s %-16s %s\n", "kernel_threads", "seconds", "yields/s",
+         "speedup");
+  double base = 0;
+  for (int n = 1; n <= kMaxKernelThreads; n *= 2) {
+    double seconds = Run(n);
+    double rate = static_cast<double>(n) * kGreenThreadsPerKernelThread *
+                  kYieldsPerGreenThread / seconds;
+    if (n == 1) {
+      base = rate;
+    }
+    printf("%-16d %-12.3f %-16.0f %.2fx%s\n", n, seconds, rate, rate / base,
+           static_cast<unsigned>(n) > cores ? " (oversubscribed)" : "");
+  }
+  return 0;
+}
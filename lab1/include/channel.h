@@ -0,0 +1,243 @@
+#ifndef CHLOROS_INCLUDE_CHANNEL_H_
+#define CHLOROS_INCLUDE_CHANNEL_H_
+
+#include "chloros.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace chloros {
+
+class Select;
+
+// State shared by the waiters of one blocked `Select`, one per case. The first
+// channel to claim it gets to complete its case; the others drop their waiter.
+struct SelectGroup {
+  // Index of the case that was picked, -1 while none is, or `kTimedOut`.
+  std::atomic<int> selected{-1};
+  static constexpr int const kTimedOut{-2};
+  // Held by the selecting thread until it is switched out.
+  SpinLock lock{};
+};
+
+// A send or receive blocked on a channel, pointed to by `Waiter::data`.
+struct ChannelOp {
+  // Set if this is one case of a `Select`.
+  SelectGroup *group = nullptr;
+  int index = 0;
+  // Value to send, or where to put the value received.
+  void *value = nullptr;
+  // Whether a value was transferred, as opposed to the channel being closed.
+  bool ok = false;
+};
+
+// Everything about a channel that does not depend on the type of its values.
+// See `Channel`.
+class ChannelBase {
+public:
+  ChannelBase(ChannelBase const &) = delete;
+  ChannelBase &operator=(ChannelBase const &) = delete;
+
+  // Close the channel. Sends fail from now on, and receives do once the values
+  // in the buffer are gone. Blocked threads are woken up and fail too.
+  void Close();
+
+  bool closed();
+  size_t size();
+  size_t capacity() const { return capacity_; }
+
+protected:
+  enum class Result {
+    kDone,
+    kClosed,
+    kWouldBlock,
+  };
+
+  explicit ChannelBase(size_t capacity) : capacity_{capacity} {}
+  virtual ~ChannelBase() = default;
+
+  // These move the `T` that `value` points to into the buffer, the value at
+  // the front of the buffer out to `value`, or one value to another.
+  virtual void PushValue(void *value) = 0;
+  virtual void PopValue(void *value) = 0;
+  virtual void MoveValue(void *from, void *to) = 0;
+
+  // Send or receive `value`, blocking if need be, but not past `deadline`.
+  // Return whether a value was transferred.
+  bool Send(void *value, Deadline deadline);
+  bool Receive(void *value, Deadline deadline);
+
+  // Same without blocking.
+  bool TrySend(void *value);
+  bool TryReceive(void *value);
+
+  // Number of values in the buffer.
+  size_t size_ = 0;
+
+private:
+  friend class Select;
+
+  // Try to send or receive without blocking. Must be called with `lock_` held.
+  // If that takes a value from or gives one to a blocked thread, it has to be
+  // woken up with `Wake` once `lock_` is released.
+  Result TrySendLocked(void *value, Waiter **wake);
+  Result TryReceiveLocked(void *value, Waiter **wake);
+
+  // Take the first waiter off `waiters` that can still go ahead, that is, all
+  // but those of a `Select` that already picked another case.
+  static Waiter *Claim(WaitList &waiters);
+  // Wake up a claimed waiter, and switch to it if `switch_to`.
+  static void Wake(Waiter *waiter, bool switch_to);
+
+  // Protects everything below, and `size_` and the buffer of `Channel`.
+  SpinLock lock_{};
+  WaitList senders_{};
+  WaitList receivers_{};
+  size_t const capacity_;
+  bool closed_ = false;
+}; // class ChannelBase
+
+// Bounded multi-producer multi-consumer channel between green threads, on one
+// kernel thread or several. Sending to a full channel parks the sender, and
+// receiving from an empty one parks the receiver, until the other side comes
+// along. A value sent while a receiver is parked goes straight to it, and the
+// sender switches to the receiver right away. With a capacity of 0, every send
+// waits for a receiver.
+template <typename T>
+class Channel : public ChannelBase {
+public:
+  explicit Channel(size_t capacity)
+      : ChannelBase{capacity}, buffer_{new Storage[capacity]} {}
+
+  ~Channel() override {
+    while (size_ > 0) {
+      Front()->~T();
+      head_ = Next(head_);
+      --size_;
+    }
+  }
+
+  // Send `value`. Blocks while the channel is full. Returns false if the
+  // channel is closed.
+  bool Send(T value) { return ChannelBase::Send(&value, Deadline::max()); }
+
+  // Receive a value into `value`. Blocks while the channel is empty. Returns
+  // false if the channel is closed and empty.
+  bool Receive(T *value) {
+    return ChannelBase::Receive(value, Deadline::max());
+  }
+
+  // Same as `Send` and `Receive`, but give up at `deadline`, or after
+  // `timeout`. They return false then too; check `closed` to tell the two
+  // apart.
+  bool SendUntil(T value, Deadline deadline) {
+    return ChannelBase::Send(&value, deadline);
+  }
+  bool SendFor(T value, std::chrono::nanoseconds timeout) {
+    return SendUntil(std::move(value), Clock::now() + timeout);
+  }
+  bool ReceiveUntil(T *value, Deadline deadline) {
+    return ChannelBase::Receive(value, deadline);
+  }
+  bool ReceiveFor(T *value, std::chrono::nanoseconds timeout) {
+    return ReceiveUntil(value, Clock::now() + timeout);
+  }
+
+  // Send `value` if that can be done without blocking. It is left alone
+  // otherwise.
+  bool TrySend(T &value) { return ChannelBase::TrySend(&value); }
+
+  // Receive a value if there is one.
+  bool TryReceive(T *value) { return ChannelBase::TryReceive(value); }
+
+private:
+  using Storage = typename std::aligned_storage<sizeof(T), alignof(T)>::type;
+
+  size_t Next(size_t index) const {
+    return index + 1 == capacity() ? 0 : index + 1;
+  }
+  T *At(size_t index) { return reinterpret_cast<T *>(&buffer_[index]); }
+  T *Front() { return At(head_); }
+
+  void PushValue(void *value) override {
+    size_t tail = head_ + size_;
+    if (tail >= capacity()) {
+      tail -= capacity();
+    }
+    new (At(tail)) T(std::move(*static_cast<T *>(value)));
+  }
+
+  void PopValue(void *value) override {
+    *static_cast<T *>(value) = std::move(*Front());
+    Front()->~T();
+    head_ = Next(head_);
+  }
+
+  void MoveValue(void *from, void *to) override {
+    *static_cast<T *>(to) = std::move(*static_cast<T *>(from));
+  }
+
+  std::unique_ptr<Storage[]> buffer_;
+  size_t head_ = 0;
+}; // class Channel
+
+// Wait on several channel operations at once, and do the first one that can
+// go ahead. When several can, the one added first wins.
+//
+//   Select select{};
+//   select.Receive(requests, &request);
+//   select.Receive(quit, &signal);
+//   switch (select.Wait()) { ... }
+class Select {
+public:
+  // Add a case receiving from `channel` into `value`. Returns its index.
+  template <typename T>
+  int Receive(Channel<T> &channel, T *value) {
+    return AddCase(&channel, false, value);
+  }
+
+  // Add a case sending `*value` to `channel`. It is moved from only if this
+  // case is picked. Returns its index.
+  template <typename T>
+  int Send(Channel<T> &channel, T *value) {
+    return AddCase(&channel, true, value);
+  }
+
+  // Block until one of the cases can go ahead, do it, and return its index. A
+  // case on a closed channel goes ahead too, with `ok()` false.
+  int Wait();
+
+  // Same, but return -1 once `deadline` has passed, or `timeout`.
+  int WaitUntil(Deadline deadline);
+  int WaitFor(std::chrono::nanoseconds timeout) {
+    return WaitUntil(Clock::now() + timeout);
+  }
+
+  // Same, but return -1 instead of blocking.
+  int TryWait();
+
+  // Whether the case picked last transferred a value.
+  bool ok() const { return ok_; }
+
+private:
+  struct Case {
+    ChannelBase *channel;
+    bool send;
+    void *value;
+  };
+
+  int AddCase(ChannelBase *channel, bool send, void *value);
+  int Run(bool block, Deadline deadline);
+
+  std::vector<Case> cases_{};
+  bool ok_ = false;
+}; // class Select
+
+} // namespace chloros
+
+#endif // CHLOROS_INCLUDE_CHANNEL_H_
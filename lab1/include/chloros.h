@@ -5,10 +5,16 @@
 #error Library only implemented for AMD64.
 #endif
 
+#include <atomic>
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <new>
+#include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 namespace chloros {
 
@@ -24,6 +30,165 @@ struct Context {
   uint64_t rbp;
   uint32_t mxcsr;
   uint32_t x87;
+  // XSAVE area of a thread spawned with `SpawnOptions::vector_state`, which
+  // holds all of its vector registers while it is switched out. Null for
+  // every other thread, whose switches only keep the registers above.
+  void *vector_state;
+};
+
+using Function = std::add_pointer<void(void *)>::type;
+
+// Default stack size is 2 MB.
+constexpr size_t const kDefaultStackSize{1 << 21};
+
+// Stack size that leaves the choice to us: the default size, or a size based
+// on the recorded stack use of the entry function when adaptive stack sizing
+// is on.
+constexpr size_t const kAutoStackSize{0};
+
+// Priorities run from 0, the lowest, to `kPriorityLevels - 1`, the highest.
+// Only the priority and MLFQ scheduling policies look at them, see
+// `GetSchedulingPolicy`.
+constexpr int const kPriorityLevels{4};
+constexpr int const kDefaultPriority{1};
+
+// Options for spawning a thread.
+struct SpawnOptions {
+  // Stack size in bytes. It is rounded up to a power of two, and to at least
+  // 16 KB. Stacks are only reserved address space until they are touched, so
+  // a large stack costs little memory unless it is actually used.
+  size_t stack_size = kAutoStackSize;
+  // Whether to put an inaccessible guard page right below the stack, so that
+  // an overflow faults instead of silently corrupting memory. Each guarded
+  // stack takes two memory mappings; threads without one are merged into few.
+  // Keep that in mind with hundreds of thousands of threads, since mappings
+  // are limited by `vm.max_map_count`.
+  bool guard_page = true;
+  // Whether the thread keeps values in vector registers across switches, say
+  // from hand-written assembly that yields. The calling convention makes
+  // every vector register caller-saved, so a switch normally leaves them be;
+  // with this on, the thread's switches also save and restore the x87, SSE,
+  // AVX and AVX-512 state with `xsaveopt` and `xrstor`, which skip whatever
+  // the thread has not touched since it last ran. The save area takes up to
+  // a few KB at the top of the stack.
+  bool vector_state = false;
+  // Scheduling priority, from 0 to `kPriorityLevels - 1`.
+  int priority = kDefaultPriority;
+};
+
+// Enter and leave a region in which the running green thread is not preempted.
+// Regions nest, and belong to the green thread, not the kernel thread. A
+// preemption that comes due inside one happens when the outermost one is left.
+// The scheduler is such a region throughout, and so is every `SpinLock` while
+// it is held. Use one around anything that must not be interleaved with other
+// green threads on the same kernel thread, like thread-local state or locks
+// that do not know about green threads.
+void DisablePreemption() __attribute__((noinline));
+void EnablePreemption() __attribute__((noinline));
+
+// Keeps preemption disabled while it is alive.
+class NoPreemptGuard {
+public:
+  NoPreemptGuard() { DisablePreemption(); }
+  ~NoPreemptGuard() { EnablePreemption(); }
+  NoPreemptGuard(NoPreemptGuard const &) = delete;
+  NoPreemptGuard &operator=(NoPreemptGuard const &) = delete;
+}; // class NoPreemptGuard
+
+// Test-and-test-and-set spin lock. Locks inside the library are only ever held
+// for a few instructions, and some of them across a context switch, which
+// rules out a kernel-level mutex. This one leaves preemption alone, so it is
+// only for code that cannot be preempted anyway, like the scheduler itself.
+class RawSpinLock {
+public:
+  void lock() {
+    while (flag_.exchange(true, std::memory_order_acquire)) {
+      while (flag_.load(std::memory_order_relaxed)) {
+        __builtin_ia32_pause();
+      }
+    }
+  }
+
+  bool try_lock() {
+    return !flag_.load(std::memory_order_relaxed) &&
+           !flag_.exchange(true, std::memory_order_acquire);
+  }
+
+  void unlock() { flag_.store(false, std::memory_order_release); }
+
+private:
+  std::atomic<bool> flag_{false};
+}; // class RawSpinLock
+
+// Spin lock whose holder cannot be preempted, or a green thread spinning on
+// the same kernel thread would never let it finish.
+class SpinLock {
+public:
+  void lock() {
+    DisablePreemption();
+    raw_.lock();
+  }
+
+  bool try_lock() {
+    DisablePreemption();
+    if (raw_.try_lock()) {
+      return true;
+    }
+    EnablePreemption();
+    return false;
+  }
+
+  void unlock() {
+    raw_.unlock();
+    EnablePreemption();
+  }
+
+private:
+  RawSpinLock raw_{};
+}; // class SpinLock
+
+struct Thread;
+class WaitList;
+
+// A thread blocked on a `WaitList`. It lives on the stack of the blocked
+// thread, so a thread can wait on several lists at once.
+struct Waiter {
+  Thread *thread = nullptr;
+  // For the primitive to use, e.g. for where to put a value handed over.
+  void *data = nullptr;
+  // List it is on, if any. Kept up to date by `WaitList`.
+  WaitList *list = nullptr;
+  Waiter *prev = nullptr;
+  Waiter *next = nullptr;
+};
+
+// First-in first-out list of waiters. It does no locking of its own; guard it
+// with the same `SpinLock` that is passed to `Park`. Waiters know the list they
+// are on, so lists cannot be copied; move waiters one by one instead.
+class WaitList {
+public:
+  WaitList() = default;
+  WaitList(WaitList const &) = delete;
+  WaitList &operator=(WaitList const &) = delete;
+
+  bool empty() const { return head_ == nullptr; }
+  Waiter *front() const { return head_; }
+  bool contains(Waiter const *waiter) const { return waiter->list == this; }
+
+  void push_back(Waiter *waiter);
+  void remove(Waiter *waiter);
+  Waiter *pop_front();
+
+private:
+  Waiter *head_ = nullptr;
+  Waiter *tail_ = nullptr;
+}; // class WaitList
+
+// A thread's value of a `FiberLocal`, see fiber_local.h, and how to destroy
+// it.
+struct FiberLocalValue {
+  void *value = nullptr;
+  void (*destroy)(void *value) = nullptr;
 };
 
 // A thread consists of a state, an execution context, and possibly a stack. For
@@ -38,6 +203,7 @@ struct Thread {
     kWaiting,
     kReady,
     kRunning,
+    kBlocked,
     kZombie,
   };
 
@@ -47,15 +213,68 @@ struct Thread {
   uint64_t id;
   State state;
   Context context;
+  // Top of the stack, i.e. its highest address.
   uint8_t *stack;
+  size_t stack_size = 0;
+  bool stack_guard_page = false;
+  // Whether the stack was painted, so its high-water mark can be measured.
+  bool stack_painted = false;
+  // Function a spawned thread runs.
+  Function entry = nullptr;
   // True, if this is the initial thread on this kernel thread.
   bool is_initial_kernel_thread = false;
+  // True, if this is the thread a kernel thread runs when nothing else can.
+  // It never leaves its kernel thread either.
+  bool is_idle_kernel_thread = false;
+  // Scheduling state of the kernel thread this thread last ran on.
+  void *kernel_thread = nullptr;
+  // Depth of the no-preemption regions the thread is in while it is switched
+  // out. New threads start out in the scheduler, which is one.
+  int preemption_disabled = 0;
+  // Priority it was spawned with, and the one it has now, which the MLFQ
+  // policy lowers while the thread keeps using up its time slices.
+  int priority = kDefaultPriority;
+  int effective_priority = kDefaultPriority;
+  // Level of the run queue it is on while it is ready.
+  int queue_level = 0;
+  // Scheduling state of the kernel thread whose run queue it is on while it
+  // is ready, so that `YieldTo` can find it there. Only written with that
+  // kernel thread's lock held.
+  std::atomic<void *> run_queue{nullptr};
+  // Time stamp counter reading when it last started running, for policies
+  // that look at how long threads run.
+  uint64_t slice_start = 0;
+  // Values of its `FiberLocal`s by slot, and how many slots there is room
+  // for.
+  FiberLocalValue *locals = nullptr;
+  size_t locals_size = 0;
+  // References to this control block: one held by the scheduler until the
+  // thread is reclaimed, plus one per `JoinHandle`.
+  std::atomic<int> refs{1};
+  // Protects `finished` and `joiners`.
+  SpinLock join_lock{};
+  bool finished = false;
+  WaitList joiners{};
+  // Links for the intrusive scheduler list this thread is on while it is not
+  // running.
+  struct Links {
+    Thread *prev = nullptr;
+    Thread *next = nullptr;
+  } links;
 
   // Constructor. `create_stack` specifies whether we want to create a stack
-  // associated with this thread.
-  Thread(bool create_stack);
+  // associated with this thread, and `options` what kind of stack.
+  Thread(bool create_stack, SpawnOptions const &options = SpawnOptions{});
   ~Thread();
 
+  // Control blocks come from a per-kernel-thread slab and stacks from a
+  // per-kernel-thread cache, so spawning does not call malloc in steady state.
+  static void *operator new(std::size_t size);
+  static void operator delete(void *block);
+
+  // Give the stack back, once the thread is done with it.
+  void ReleaseStack();
+
   // Disable copying and moving.
   Thread(Thread const &) = delete;
   Thread(Thread &&) = delete;
@@ -67,8 +286,6 @@ struct Thread {
   void PrintDebug();
 };
 
-using Function = std::add_pointer<void(void *)>::type;
-
 // Initialize with current context. This function will grab current running
 // context and set it as `current_thread`, so we have something to switch from.
 // This must be run before all other threading functions on each kernel thread.
@@ -79,9 +296,144 @@ using Function = std::add_pointer<void(void *)>::type;
 // extra credit phase)?
 void Initialize();
 
+// Handle to a spawned thread, for waiting until it has finished. Handles can
+// be copied, and keep the thread's control block, but not its stack, alive
+// after it exits.
+class JoinHandle {
+public:
+  JoinHandle() = default;
+  // Takes a new reference to `thread`.
+  explicit JoinHandle(Thread *thread);
+  JoinHandle(JoinHandle const &other);
+  JoinHandle(JoinHandle &&other) noexcept;
+  JoinHandle &operator=(JoinHandle other) noexcept;
+  ~JoinHandle();
+
+  // Block the current thread until the thread has finished. Other threads run
+  // in the meantime.
+  void Join() const;
+
+  bool Finished() const;
+  uint64_t id() const;
+  bool valid() const { return thread_ != nullptr; }
+  Thread *thread() const { return thread_; }
+
+private:
+  Thread *thread_ = nullptr;
+}; // class JoinHandle
+
 // Create a new green thread and execute function inside it. After allocating
 // and initializing the thread, current thread must yield execution to it.
-void Spawn(Function fn, void *arg);
+JoinHandle Spawn(Function fn, void *arg);
+
+// Same as above, but with a specific kind of stack.
+JoinHandle Spawn(Function fn, void *arg, SpawnOptions const &options);
+
+// Create a new green thread, but keep running the current one instead of
+// yielding to it. The new thread goes to the back of the run queue.
+void SpawnDetached(Function fn, void *arg,
+                   SpawnOptions const &options = SpawnOptions{});
+
+// Create `n` green threads running `fn`, the i-th one with `args[i]`, and put
+// them on the run queue all at once, in that order. Like `SpawnDetached`, this
+// does not yield. Fanning out this way keeps the caller's caches warm instead
+// of switching back and forth once per thread.
+void SpawnMany(Function fn, void *const *args, size_t n,
+               SpawnOptions const &options = SpawnOptions{});
+
+// Spawning in two steps, for arguments that are built in place on the new
+// thread's stack: `PrepareThread` sets up a thread that will run
+// `fn(storage)`, where `storage` points to `size` bytes aligned to `alignment`
+// at the top of its stack, and `Launch` or `LaunchDetached` starts it once the
+// caller has filled them in, like `Spawn` or `SpawnDetached` would. The
+// storage must take at most a quarter of the stack.
+Thread *PrepareThread(Function fn, size_t size, size_t alignment,
+                      SpawnOptions const &options, void **storage);
+JoinHandle Launch(Thread *thread);
+void LaunchDetached(Thread *thread);
+
+// Same as `LaunchDetached`, but hand back a handle, and wake up a kernel thread
+// that is asleep for lack of work, if there is one, to come and steal the
+// thread. For work split off to run in parallel, see parallel.h.
+JoinHandle LaunchShared(Thread *thread);
+
+// A callable and its arguments, which a thread spawned with them keeps at the
+// top of its stack.
+template <typename F, typename... Args>
+class SpawnedClosure {
+public:
+  template <typename G, typename... As>
+  explicit SpawnedClosure(G &&f, As &&...args)
+      : values_{std::forward<G>(f), std::forward<As>(args)...} {}
+
+  // Entry function of the thread: call the callable with the arguments, and
+  // destroy them all in place.
+  static void Run(void *storage) {
+    auto closure = static_cast<SpawnedClosure *>(storage);
+    closure->Call(std::index_sequence_for<Args...>{});
+    closure->~SpawnedClosure();
+  }
+
+private:
+  template <size_t... I>
+  void Call(std::index_sequence<I...>) {
+    std::move(std::get<0>(values_))(std::move(std::get<I + 1>(values_))...);
+  }
+
+  std::tuple<F, Args...> values_;
+}; // class SpawnedClosure
+
+// Functions that take a `void *`, and whatever converts to `Function`, go to
+// the spawns above, or to the one in future.h for those returning a value.
+template <typename F>
+struct TakesVoidPointer : std::false_type {};
+template <typename R>
+struct TakesVoidPointer<R (*)(void *)> : std::true_type {};
+
+template <typename F>
+using EnableIfClosure = typename std::enable_if<
+    !TakesVoidPointer<typename std::decay<F>::type>::value &&
+    !std::is_convertible<F, Function>::value &&
+    !std::is_same<typename std::decay<F>::type, SpawnOptions>::value>::type;
+
+// Spawn a thread that calls `f(args...)`, like `std::thread` does, with
+// decayed copies of `f` and `args` moved into the top of its stack rather than
+// the heap. They are destroyed when it returns.
+template <typename F, typename... Args>
+JoinHandle Spawn(SpawnOptions const &options, F &&f, Args &&...args) {
+  using Closure = SpawnedClosure<typename std::decay<F>::type,
+                                 typename std::decay<Args>::type...>;
+  NoPreemptGuard guard{};
+  void *storage = nullptr;
+  Thread *thread = PrepareThread(Closure::Run, sizeof(Closure),
+                                 alignof(Closure), options, &storage);
+  new (storage) Closure{std::forward<F>(f), std::forward<Args>(args)...};
+  return Launch(thread);
+}
+
+template <typename F, typename... Args, typename = EnableIfClosure<F>>
+JoinHandle Spawn(F &&f, Args &&...args) {
+  return Spawn(SpawnOptions{}, std::forward<F>(f), std::forward<Args>(args)...);
+}
+
+// Same as above, but keep running the current thread, like `SpawnDetached`.
+template <typename F, typename... Args>
+void SpawnDetached(SpawnOptions const &options, F &&f, Args &&...args) {
+  using Closure = SpawnedClosure<typename std::decay<F>::type,
+                                 typename std::decay<Args>::type...>;
+  NoPreemptGuard guard{};
+  void *storage = nullptr;
+  Thread *thread = PrepareThread(Closure::Run, sizeof(Closure),
+                                 alignof(Closure), options, &storage);
+  new (storage) Closure{std::forward<F>(f), std::forward<Args>(args)...};
+  LaunchDetached(thread);
+}
+
+template <typename F, typename... Args, typename = EnableIfClosure<F>>
+void SpawnDetached(F &&f, Args &&...args) {
+  SpawnDetached(SpawnOptions{}, std::forward<F>(f),
+                std::forward<Args>(args)...);
+}
 
 // Yield execution. Make sure it behaves like a round-robin scheduler! Returns
 // whether the action was successful. If there are no other thread to yield to,
@@ -89,19 +441,249 @@ void Spawn(Function fn, void *arg);
 // threads. This is important because if the initial threads yield to other
 // initial threads that are stuck in `Wait()`, it will loop forever. Again, you
 // will have multiple initial threads only in the extra credit phase where you
-// have multiple kernel threads. So you could ignore this for now.
+// have multiple kernel threads. So you could ignore this for now. Ready threads
+// always go before waiting ones.
 bool Yield(bool only_ready = false) __attribute__((noinline));
 
+// Switch straight to `thread`, instead of whichever thread is next in line,
+// provided it is ready: on a run queue, ours or a peer's. The current thread
+// goes back on its run queue, as with `Yield`. Hands the CPU to a thread that
+// was just given work, without waiting for every other ready thread to run
+// first. Returns false without yielding if the thread is running, blocked,
+// finished, or the initial thread of another kernel thread.
+bool YieldTo(Thread *thread);
+bool YieldTo(JoinHandle const &handle);
+
 // Wait till all other green threads are done. Call this only from initial
 // threads. It will wait for ready threads but not other waiting threads.
 // Otherwise multiple waiting threads will wait for each other indefinitely. And
-// this is the scenario where a thread will become waiting.
+// this is the scenario where a thread will become waiting. It also waits for
+// threads that blocked on this kernel thread to be woken up.
 void Wait();
 
-// Get rid of zombies before they overwhelm us!
+// Get rid of zombies before they overwhelm us! Exited threads are reclaimed
+// by the next context switch on their kernel thread, in constant time, so by
+// the time anybody could call this, there is nothing left to do.
 void GarbageCollect();
 
-// Get number of ready and zombie threads. Used only in testing.
+// Block the current thread. The caller must hold `lock`, and must have put the
+// thread somewhere it can be found by whoever will wake it up, usually on a
+// `WaitList` guarded by `lock`. The lock is released only once the thread is
+// switched out, so it cannot be woken up before that. Returns after `Unpark`,
+// with `lock` released. Other threads, or the idle loop, run in the meantime.
+void Park(SpinLock &lock);
+
+// Make a thread blocked in `Park` ready again. Initial threads go back to their
+// own kernel thread, all others to the caller's run queue.
+void Unpark(Thread *thread);
+
+// Same as `Unpark`, but also switch to the thread right away. The current
+// thread goes to the front of the run queue, so it is next once the woken up
+// thread yields or blocks. Used to hand a value to a blocked thread without
+// making it wait for its turn. Falls back on `Unpark` for the initial threads
+// of other kernel threads.
+void UnparkAndSwitch(Thread *thread);
+
+// The thread running right now.
+Thread *CurrentThread() __attribute__((noinline));
+
+// Clock that every timeout in the library is measured on.
+using Clock = std::chrono::steady_clock;
+using Deadline = Clock::time_point;
+
+// Block the current thread until `deadline`, or for `duration`. Each kernel
+// thread keeps the timeouts of the threads blocked on it in a timing wheel, to
+// the microsecond, and looks for expired ones when it runs out of threads to
+// run, and every few yields otherwise. One with nothing to do but wait for
+// timers sleeps until the next one is due, in epoll if any thread on it waits
+// for I/O, or else on a futex. Whoever hands it a thread in the meantime wakes
+// it up either way, through an eventfd in its epoll set in the first case. A
+// thread only wakes up early if it was woken up by something else.
+void SleepUntil(Deadline deadline);
+void SleepFor(std::chrono::nanoseconds duration);
+
+// Same as `Park`, but give up at `deadline`. The thread must have put `waiter`
+// on `waiters`, guarded by `lock`. If the waiter is still on the list when the
+// deadline passes, it is taken off and the thread is woken up, and this
+// returns false. Otherwise whoever took it off must wake the thread up, and
+// this returns true.
+bool ParkUntil(SpinLock &lock, WaitList &waiters, Waiter *waiter,
+               Deadline deadline);
+
+// Default time slice for preemption.
+constexpr std::chrono::microseconds const kDefaultTimeSlice{10000};
+
+// Turn preemption on or off for the calling kernel thread, which must have
+// called `Initialize`. While it is on, a timer interrupts the kernel thread
+// every time slice of CPU time it uses, and switches to the next ready thread
+// unless the running one is in a no-preemption region or outside the code of
+// the program itself, e.g. in the C library. Interrupted threads are switched
+// from inside a signal handler, so their complete register state, including
+// all of the vector registers, is kept in the signal frame on their stack. A
+// blocking system call that cannot be restarted, like `nanosleep`, may fail
+// with `EINTR` while preemption is on.
+void SetPreemption(bool enabled);
+
+// Set the time slice of kernel threads that turn preemption on from now on.
+void SetTimeSlice(std::chrono::microseconds slice);
+
+// Set how many free stacks of the default size each kernel thread keeps for
+// reuse by later spawns. Smaller stacks are kept in proportionally larger
+// numbers, e.g. 128 times as many 16 KB stacks, so the cache reserves about the
+// same address space whatever the size. Stacks freed beyond that go back to
+// the system. Defaults to 16.
+void SetStackCacheLimit(size_t stacks);
+
+// Stack use of the threads that ran one entry function, as far as it was
+// measured.
+struct StackUsage {
+  // Number of threads measured.
+  uint64_t threads = 0;
+  // Deepest stack use seen, in bytes.
+  size_t max_bytes = 0;
+  // Stack use of all threads measured added up, in bytes.
+  size_t total_bytes = 0;
+};
+
+// Turn stack painting on or off. Threads spawned while it is on get painted
+// stacks, and how deep they went is recorded per entry function when they
+// exit. Painting resets the stack to untouched pages, which costs a system
+// call per spawn, and measuring takes a scan of a single page.
+void SetStackPainting(bool enabled);
+
+// Get the recorded stack use of threads that ran `fn`.
+StackUsage GetStackUsage(Function fn);
+
+// Get the recorded stack use for every entry function seen.
+std::vector<std::pair<Function, StackUsage>> GetStackUsageReport();
+
+// Turn adaptive stack sizing on or off. While it is on, a thread spawned with
+// `kAutoStackSize` gets a stack as deep as the deepest use recorded for its
+// entry function plus a safety margin, or the default size if nothing is
+// recorded yet. Turning it on also turns on painting, so the numbers keep up
+// with threads that go deeper than before. Combine it with guard pages: a
+// thread that goes much deeper than any before it will overflow.
+void SetAdaptiveStackSize(bool enabled);
+
+// Scheduler counters of a kernel thread, or of several added up. All but
+// `run_queue_depth` only ever grow.
+struct SchedulerCounters {
+  uint64_t context_switches = 0;
+  // Calls to `Yield` that found nothing else to run.
+  uint64_t empty_yields = 0;
+  uint64_t spawns = 0;
+  uint64_t exits = 0;
+  // Threads taken off the queue of another kernel thread.
+  uint64_t steals = 0;
+  // Threads ready to run in the queue at the time of reading.
+  uint64_t run_queue_depth = 0;
+  // Time stamp counter ticks spent running green threads, and spent in the
+  // idle thread, up to the time of reading.
+  uint64_t busy_cycles = 0;
+  uint64_t idle_cycles = 0;
+};
+
+// Time a green thread spent running, in time stamp counter ticks, and how many
+// times it was switched away from.
+struct ThreadStats {
+  uint64_t id = 0;
+  uint64_t cycles = 0;
+  uint64_t switches = 0;
+};
+
+struct SchedulerStats {
+  // Whether the library was built with statistics, i.e. with
+  // `CHLOROS_STATS`. Everything else is zero if not.
+  bool enabled = false;
+  // Everything added up, including kernel threads that are gone and spawns
+  // from kernel threads that never called `Initialize`.
+  SchedulerCounters total{};
+  // One per kernel thread that is initialized right now.
+  std::vector<SchedulerCounters> kernel_threads{};
+  // One per green thread that ran while the per-thread breakdown was on,
+  // exited ones included, by `Thread::id`. See `SetPerThreadStats`.
+  std::vector<ThreadStats> threads{};
+};
+
+// Read the scheduler statistics. Each kernel thread keeps its own counters,
+// which only it writes, so keeping them costs a few plain stores per switch,
+// and a time stamp counter read only when the kernel thread goes idle or back
+// to work, and reading them takes no locks. Counters of
+// different kernel threads are not read at one instant, so they may be off
+// from each other by whatever happened in the meantime.
+SchedulerStats GetSchedulerStats();
+
+// Turn the per-thread breakdown of `SchedulerStats::threads` on or off. Turning
+// it on starts afresh. It costs a time stamp counter read and a hash table
+// update per switch, and memory for every thread that runs, so it is off by
+// default.
+void SetPerThreadStats(bool enabled);
+
+// Scheduling events the tracer records, see `SetTracing`.
+enum class TraceEventType : uint32_t {
+  // `thread` was switched to, from `arg`.
+  kSwitch,
+  // The kernel thread ran out of threads to run, and switched away from
+  // `thread` to its idle loop.
+  kIdle,
+  // `thread` was spawned by `arg`.
+  kSpawn,
+  // `thread` exited.
+  kExit,
+  // `thread` blocked in `Park`.
+  kPark,
+  // `thread` was woken up by `arg`.
+  kWake,
+  // `thread` was stolen from kernel thread `arg`.
+  kSteal,
+};
+
+struct TraceEvent {
+  // Time stamp counter reading when it happened.
+  uint64_t tsc = 0;
+  TraceEventType type = TraceEventType::kSwitch;
+  // Kernel thread it happened on. Kernel threads are numbered in the order
+  // they first called `Initialize`, and a number is reused by the next kernel
+  // thread to initialize once its own has exited.
+  uint32_t kernel_thread = 0;
+  // `Thread::id` of the green thread it is about.
+  uint64_t thread = 0;
+  // Depends on the type, see `TraceEventType`.
+  uint64_t arg = 0;
+};
+
+// Number of the latest events each kernel thread keeps for the tracer.
+constexpr size_t const kTraceEvents{1 << 16};
+
+// Turn the scheduling tracer on or off. While it is on, each kernel thread
+// records its switches, spawns, exits, parks, wakeups and steals into a ring
+// buffer of its own, overwriting the oldest events once it is full. Recording
+// an event takes a time stamp counter read and a few plain stores, with no
+// locks or system calls; while it is off, it takes a load and a branch.
+// Turning it on starts afresh. Kernel threads that never called `Initialize`
+// record nothing, e.g. when they wake up a thread.
+void SetTracing(bool enabled);
+
+// Events recorded since the tracer was last turned on, oldest first, as far
+// as they were not overwritten. Safe to call while threads are recording.
+std::vector<TraceEvent> GetTrace();
+
+// Write `GetTrace` to `path` as Chrome trace_event JSON, which both
+// chrome://tracing and Perfetto open: a track per kernel thread, with a slice
+// for each stretch of time a green thread ran there, and instant events for
+// everything else. Returns false if the file cannot be written.
+bool WriteChromeTrace(char const *path);
+
+// Name of the scheduling policy the library was built with: "fifo", round
+// robin, with new threads and threads that hand over their turn going first;
+// "lifo", the most recently queued thread first; "priority", strict priority,
+// with FIFO order within each priority; or "mlfq", a multi-level feedback queue
+// that starts threads at their priority and moves threads that keep running
+// for long between switches down a level.
+char const *GetSchedulingPolicy();
+
+// Get number of ready (including waiting and blocked) and zombie threads. Used
+// only in testing; use `GetSchedulerStats` for monitoring.
 std::pair<int, int> GetThreadCount();
 
 extern "C" {
@@ -0,0 +1,78 @@
+#ifndef CHLOROS_INCLUDE_FIBER_LOCAL_H_
+#define CHLOROS_INCLUDE_FIBER_LOCAL_H_
+
+#include "chloros.h"
+#include <cstddef>
+
+namespace chloros {
+
+// Reserve a slot for a new `FiberLocal`. Slots are never reused.
+size_t AllocateFiberLocalSlot();
+
+// Give the running thread `value` in `slot`, to be destroyed by calling
+// `destroy` on it when the thread exits. The slot must be empty.
+void SetFiberLocal(size_t slot, void *value, void (*destroy)(void *value));
+
+// Storage that every green thread has an instance of its own, unlike
+// `thread_local`, which belongs to the kernel thread and is shared by all the
+// green threads that run on it. Each `FiberLocal` has a slot, and each thread
+// an array of values by slot, so finding the value of the running thread is
+// a bounds check and a load. A thread's value is constructed the first time
+// it uses it, and destroyed when it exits, right after its entry function
+// returns, while it can still block. Values set by those destructors are
+// destroyed as well, for a few rounds. Initial threads destroy theirs when
+// their kernel thread exits.
+//
+// Meant for long-lived objects like globals. A slot is never handed out again,
+// and values of a `FiberLocal` that is gone are still destroyed on exit.
+template <typename T>
+class FiberLocal {
+public:
+  FiberLocal() : slot_{AllocateFiberLocalSlot()} {}
+
+  FiberLocal(FiberLocal const &) = delete;
+  FiberLocal &operator=(FiberLocal const &) = delete;
+
+  // The value of the running thread, default constructed on first use.
+  T &get() {
+    T *value = Find();
+    if (value == nullptr) {
+      value = new T();
+      SetFiberLocal(slot_, value, Destroy);
+    }
+    return *value;
+  }
+
+  T &operator*() { return get(); }
+  T *operator->() { return &get(); }
+
+  // Whether the running thread has constructed its value.
+  bool has_value() const { return Find() != nullptr; }
+
+  // Destroy the value of the running thread, if it has one. The next use
+  // constructs a new one.
+  void reset() {
+    T *value = Find();
+    if (value != nullptr) {
+      CurrentThread()->locals[slot_].value = nullptr;
+      Destroy(value);
+    }
+  }
+
+private:
+  T *Find() const {
+    Thread *thread = CurrentThread();
+    if (slot_ >= thread->locals_size) {
+      return nullptr;
+    }
+    return static_cast<T *>(thread->locals[slot_].value);
+  }
+
+  static void Destroy(void *value) { delete static_cast<T *>(value); }
+
+  size_t const slot_;
+}; // class FiberLocal
+
+} // namespace chloros
+
+#endif // CHLOROS_INCLUDE_FIBER_LOCAL_H_
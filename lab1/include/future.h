@@ -0,0 +1,115 @@
+#ifndef CHLOROS_INCLUDE_FUTURE_H_
+#define CHLOROS_INCLUDE_FUTURE_H_
+
+#include "chloros.h"
+#include <atomic>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace chloros {
+
+// Result of a thread spawned with a function that returns a value. It is shared
+// between the thread computing it and its `Future`, whichever lets go last
+// frees it.
+template <typename T>
+class FutureState {
+public:
+  FutureState(T (*fn)(void *), void *arg) : fn_{fn}, arg_{arg} {}
+
+  ~FutureState() {
+    if (has_value_) {
+      value()->~T();
+    }
+  }
+
+  FutureState(FutureState const &) = delete;
+  FutureState &operator=(FutureState const &) = delete;
+
+  // Entry function of the thread computing the result.
+  static void Run(void *arg) {
+    auto state = static_cast<FutureState *>(arg);
+    new (&state->storage_) T(state->fn_(state->arg_));
+    state->has_value_ = true;
+    state->Release();
+  }
+
+  void Release() {
+    if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+
+  // Only valid once the thread has finished.
+  T *value() { return reinterpret_cast<T *>(&storage_); }
+
+private:
+  T (*fn_)(void *);
+  void *arg_;
+  // One for the thread, and one for the future.
+  std::atomic<int> refs_{2};
+  bool has_value_ = false;
+  typename std::aligned_storage<sizeof(T), alignof(T)>::type storage_;
+}; // class FutureState
+
+// Value computed by a green thread. Getting it parks the caller until the
+// thread has finished, the same way `JoinHandle::Join` does.
+template <typename T>
+class Future {
+public:
+  Future() = default;
+  Future(JoinHandle handle, FutureState<T> *state)
+      : handle_{std::move(handle)}, state_{state} {}
+
+  Future(Future &&other) noexcept
+      : handle_{std::move(other.handle_)}, state_{other.state_} {
+    other.state_ = nullptr;
+  }
+
+  Future &operator=(Future &&other) noexcept {
+    std::swap(handle_, other.handle_);
+    std::swap(state_, other.state_);
+    return *this;
+  }
+
+  Future(Future const &) = delete;
+  Future &operator=(Future const &) = delete;
+
+  ~Future() {
+    if (state_ != nullptr) {
+      state_->Release();
+    }
+  }
+
+  // Block until the value is there.
+  void Join() const { handle_.Join(); }
+
+  // Block until the value is there, and get it. It stays owned by the future.
+  T &Get() {
+    handle_.Join();
+    return *state_->value();
+  }
+
+  bool Ready() const { return handle_.Finished(); }
+  bool valid() const { return state_ != nullptr; }
+  JoinHandle const &handle() const { return handle_; }
+
+private:
+  JoinHandle handle_{};
+  FutureState<T> *state_ = nullptr;
+}; // class Future
+
+// Like `Spawn`, but for a function returning a value, which the returned
+// future gets hold of.
+template <typename T>
+typename std::enable_if<!std::is_void<T>::value, Future<T>>::type
+Spawn(T (*fn)(void *), void *arg,
+      SpawnOptions const &options = SpawnOptions{}) {
+  auto state = new FutureState<T>(fn, arg);
+  JoinHandle handle = Spawn(FutureState<T>::Run, state, options);
+  return Future<T>{std::move(handle), state};
+}
+
+} // namespace chloros
+
+#endif // CHLOROS_INCLUDE_FUTURE_H_
@@ -0,0 +1,86 @@
+#ifndef CHLOROS_INCLUDE_IO_H_
+#define CHLOROS_INCLUDE_IO_H_
+
+#include "chloros.h"
+#include <cstddef>
+#include <cstdint>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+namespace chloros {
+
+namespace io {
+
+// I/O that blocks the calling green thread, but not its kernel thread. Each of
+// these behaves like the system call of the same name, including how errors
+// are reported, but puts the file descriptor into non-blocking mode and, when
+// the call would block, parks the thread until the kernel thread sees the
+// descriptor become ready. Kernel threads look for ready descriptors whenever
+// they run out of threads to run, and every few yields otherwise. At most one
+// thread at a time may wait to read from a descriptor, and one to write to it.
+// Only for green threads, i.e. on kernel threads that called `Initialize`.
+
+// Read up to `size` bytes. Returns 0 at end of file.
+ssize_t Read(int fd, void *buffer, size_t size);
+
+// Write all `size` bytes, like a blocking socket would. If an error comes up
+// halfway, returns how many bytes were written before it.
+ssize_t Write(int fd, void const *buffer, size_t size);
+
+// Accept a connection on the listening socket `fd`. The new socket is already
+// non-blocking.
+int Accept(int fd, sockaddr *address, socklen_t *length);
+
+// Connect the socket `fd` to `address`.
+int Connect(int fd, sockaddr const *address, socklen_t length);
+
+// Block until `fd` can be read from without blocking, or written to.
+void WaitReadable(int fd);
+void WaitWritable(int fd);
+
+// Same, but give up at `deadline`. Returns false if it passed first.
+bool WaitReadable(int fd, Deadline deadline);
+bool WaitWritable(int fd, Deadline deadline);
+
+// Read up to `size` bytes at `offset`, like `pread`. Unlike the calls above,
+// this works for regular files, which epoll considers always ready even when
+// a read would wait for the disk. The read is queued on the kernel thread's
+// io_uring, and everything queued there goes to the kernel in one system call
+// once the kernel thread runs out of threads to run, or every few yields. The
+// calling thread is parked until its read is done. Where io_uring is not
+// available, or turned off, the read is carried out by a helper kernel thread
+// instead.
+ssize_t PRead(int fd, void *buffer, size_t size, off_t offset);
+
+// Write up to `size` bytes at `offset`, like `pwrite`. See `PRead`.
+ssize_t PWrite(int fd, void const *buffer, size_t size, off_t offset);
+
+// Turn the use of io_uring by `PRead` and `PWrite` on or off, for every kernel
+// thread. It is on by default. While it is off, they use helper threads.
+void SetUring(bool enabled);
+
+// Have `Read` and `Write` on a socket that would block queue the transfer on
+// the kernel thread's io_uring, batched like `PRead`, instead of waiting for
+// epoll to report the socket ready and then trying again. It only applies
+// while `SetUring` is on, and turns itself off on kernels that fail io_uring
+// transfers on non-blocking sockets instead of waiting. It is off by default:
+// with the readiness check done up front either way, epoll has been as fast
+// or faster, see bench/echo.cpp.
+void SetUringSockets(bool enabled);
+
+// Counters of `PRead` and `PWrite` calls, and of the system calls made on
+// their behalf, by any kernel thread. Only calls that are there for file I/O
+// are counted: reads and writes, io_uring submissions, polls for their
+// completions, and helper thread wakeups.
+struct FileIoStats {
+  uint64_t operations = 0;
+  uint64_t system_calls = 0;
+};
+
+FileIoStats GetFileIoStats();
+
+} // namespace io
+
+} // namespace chloros
+
+#endif // CHLOROS_INCLUDE_IO_H_
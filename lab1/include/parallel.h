@@ -0,0 +1,102 @@
+#ifndef CHLOROS_INCLUDE_PARALLEL_H_
+#define CHLOROS_INCLUDE_PARALLEL_H_
+
+#include "chloros.h"
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace chloros {
+
+// Whether peers would take work off the calling kernel thread's hands right
+// now, as far as it can tell: there are other kernel threads, and none of the
+// threads queued here are left for them to steal. It takes a couple of loads,
+// so it is cheap enough to ask between chunks of a loop.
+bool PeersWantWork();
+
+// Spawn a thread that calls `f()` for peers to steal, see `LaunchShared`.
+template <typename F>
+JoinHandle SpawnShared(F &&f) {
+  using Closure = SpawnedClosure<typename std::decay<F>::type>;
+  NoPreemptGuard guard{};
+  void *storage = nullptr;
+  Thread *thread = PrepareThread(Closure::Run, sizeof(Closure),
+                                 alignof(Closure), SpawnOptions{}, &storage);
+  new (storage) Closure{std::forward<F>(f)};
+  return LaunchShared(thread);
+}
+
+// Wait for a thread spawned with `SpawnShared`. If no peer took it, it runs
+// right away instead of waiting for its turn.
+inline void JoinShared(JoinHandle const &handle) {
+  YieldTo(handle);
+  handle.Join();
+}
+
+// Reduce [begin, end) for `ParallelReduce`, going through it from the front
+// `grain` indices at a time, and splitting the upper half of what is left off
+// into a thread of its own as soon as peers want work.
+template <typename Index, typename T, typename F, typename C>
+T ReduceRange(Index begin, Index end, size_t grain, T const &identity,
+              F const &fn, C const &combine) {
+  T value = identity;
+  while (begin < end) {
+    size_t size = static_cast<size_t>(end - begin);
+    if (size > grain && PeersWantWork()) {
+      Index middle = begin + static_cast<Index>(size / 2);
+      T upper = identity;
+      JoinHandle handle = SpawnShared([&, middle, end] {
+        upper = ReduceRange(middle, end, grain, identity, fn, combine);
+      });
+      // The upper half is queued here now, so this does not split again
+      // before a peer takes it.
+      value = combine(std::move(value),
+                      ReduceRange(begin, middle, grain, identity, fn, combine));
+      JoinShared(handle);
+      return combine(std::move(value), std::move(upper));
+    }
+    Index stop = size > grain ? begin + static_cast<Index>(grain) : end;
+    for (; begin < stop; ++begin) {
+      value = combine(std::move(value), fn(begin));
+    }
+  }
+  return value;
+}
+
+// Combine `fn(i)` for every `i` in [begin, end) with `combine`, in parallel on
+// the kernel threads that steal from this one, like the workers of a
+// `Runtime`. Each part of the range starts out from `identity`, and parts are
+// combined in order, so `combine` must be associative, but need not be
+// commutative. Splitting is lazy: the caller works through the range itself,
+// `grain` indices at a time, and only hands half of what is left to a new
+// thread when peers have run out of work, which then does the same. A range
+// of at most `grain` indices, or one on a kernel thread without peers, is
+// done right here without spawning anything. Call it from any thread of a
+// kernel thread that called `Initialize`.
+template <typename Index, typename T, typename F, typename C>
+T ParallelReduce(Index begin, Index end, size_t grain, T const &identity,
+                 F const &fn, C const &combine) {
+  static_assert(std::is_integral<Index>::value, "Index must be an integer.");
+  return ReduceRange(begin, end, std::max<size_t>(grain, 1), identity, fn,
+                     combine);
+}
+
+// Call `fn(i)` for every `i` in [begin, end), in parallel the same way as
+// `ParallelReduce`, and return once all calls have.
+template <typename Index, typename F>
+void ParallelFor(Index begin, Index end, size_t grain, F const &fn) {
+  struct Nothing {};
+  ParallelReduce(
+      begin, end, grain, Nothing{},
+      [&fn](Index i) {
+        fn(i);
+        return Nothing{};
+      },
+      [](Nothing, Nothing) { return Nothing{}; });
+}
+
+} // namespace chloros
+
+#endif // CHLOROS_INCLUDE_PARALLEL_H_
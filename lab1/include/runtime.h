@@ -0,0 +1,81 @@
+#ifndef CHLOROS_INCLUDE_RUNTIME_H_
+#define CHLOROS_INCLUDE_RUNTIME_H_
+
+#include "chloros.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace chloros {
+
+struct KernelThread;
+
+// Options for starting a `Runtime`.
+struct RuntimeOptions {
+  // Number of worker kernel threads. Zero means one per core we may run on.
+  size_t workers = 0;
+  // Whether to pin each worker to a core of its own, round-robin over the
+  // cores we may run on.
+  bool pin_workers = true;
+  // Whether workers turn on preemption, see `SetPreemption`.
+  bool preemption = false;
+};
+
+// A fixed pool of worker kernel threads that run green threads spawned from
+// anywhere, including kernel threads that never called `Initialize`. Threads
+// spawned from outside go to the least loaded of two workers picked
+// round-robin, threads spawned from a worker stay there at first. Either way,
+// they move to whichever worker runs out of work first, by stealing. The
+// initial thread of each worker, which runs the worker loop, never leaves it.
+class Runtime {
+public:
+  explicit Runtime(RuntimeOptions const &options = RuntimeOptions{});
+  // Drains the runtime, see `Shutdown`.
+  ~Runtime();
+  Runtime(Runtime const &) = delete;
+  Runtime &operator=(Runtime const &) = delete;
+
+  // Create a green thread running `fn(arg)` on one of the workers. It does not
+  // yield, even when called from a green thread. The handle can only be joined
+  // from green threads; other kernel threads wait for the whole runtime with
+  // `Shutdown` instead. Must not be called once `Shutdown` has been.
+  JoinHandle Spawn(Function fn, void *arg,
+                   SpawnOptions const &options = SpawnOptions{});
+
+  // Wait for every green thread on the workers to finish, including the ones
+  // they spawn in the meantime, then stop the workers. Each worker leaves as
+  // soon as it has nothing left to run and no blocked threads to wait for.
+  // Must not be called from one of the workers.
+  void Shutdown();
+
+  size_t workers() const { return workers_.size(); }
+
+private:
+  struct Worker {
+    std::thread thread{};
+    KernelThread *kernel_thread = nullptr;
+  };
+
+  void Work(size_t index);
+
+  RuntimeOptions options_;
+  std::vector<Worker> workers_{};
+  // Round-robin position for threads spawned from outside.
+  std::atomic<size_t> next_worker_{0};
+
+  // Workers that registered with the runtime, guarded by `start_lock_`. Idle
+  // workers sleep in the scheduler, which wakes them up when there is work.
+  std::mutex start_lock_{};
+  std::condition_variable start_cv_{};
+  size_t started_ = 0;
+  std::atomic<bool> stopping_{false};
+  bool stopped_ = false;
+}; // class Runtime
+
+} // namespace chloros
+
+#endif // CHLOROS_INCLUDE_RUNTIME_H_
@@ -0,0 +1,128 @@
+#ifndef CHLOROS_INCLUDE_SYNC_H_
+#define CHLOROS_INCLUDE_SYNC_H_
+
+#include "chloros.h"
+#include <chrono>
+#include <cstddef>
+
+namespace chloros {
+
+// Synchronization between green threads. A thread that has to wait is parked
+// on a list attached to the primitive, so the rest of its kernel thread keeps
+// running, and it is made ready again by whoever releases it. They work across
+// kernel threads, but may only be used from green threads, i.e. on kernel
+// threads that called `Initialize`. Waits with a deadline give up once it has
+// passed, see `ParkUntil`.
+
+// Mutual exclusion lock. Ownership is handed straight to the longest waiting
+// thread on unlock, so waiters are served in order and cannot starve. It
+// satisfies the standard TimedLockable requirements for `Clock`, so
+// `std::lock_guard` and `std::unique_lock` work with it.
+class Mutex {
+public:
+  Mutex() = default;
+  Mutex(Mutex const &) = delete;
+  Mutex &operator=(Mutex const &) = delete;
+
+  void lock();
+  bool try_lock();
+  bool try_lock_until(Deadline deadline);
+  bool try_lock_for(std::chrono::nanoseconds timeout) {
+    return try_lock_until(Clock::now() + timeout);
+  }
+  void unlock();
+
+private:
+  // Protects the members below.
+  SpinLock lock_{};
+  bool locked_ = false;
+  WaitList waiters_{};
+}; // class Mutex
+
+// Condition variable to go with a `Mutex`. There are no spurious wakeups, but
+// the condition may have changed again by the time a woken up thread gets the
+// mutex back, so check it in a loop.
+class CondVar {
+public:
+  CondVar() = default;
+  CondVar(CondVar const &) = delete;
+  CondVar &operator=(CondVar const &) = delete;
+
+  // Unlock `mutex`, block until signalled, and lock `mutex` again.
+  void Wait(Mutex &mutex);
+
+  // Same as above, until `predicate()` holds.
+  template <typename Predicate>
+  void Wait(Mutex &mutex, Predicate predicate) {
+    while (!predicate()) {
+      Wait(mutex);
+    }
+  }
+
+  // Same as `Wait`, but give up at `deadline`, or after `timeout`. `mutex` is
+  // locked again either way. Returns false if the time ran out.
+  bool WaitUntil(Mutex &mutex, Deadline deadline);
+  bool WaitFor(Mutex &mutex, std::chrono::nanoseconds timeout) {
+    return WaitUntil(mutex, Clock::now() + timeout);
+  }
+
+  // Same, until `predicate()` holds. Returns what it returned last.
+  template <typename Predicate>
+  bool WaitUntil(Mutex &mutex, Deadline deadline, Predicate predicate) {
+    while (!predicate()) {
+      if (!WaitUntil(mutex, deadline)) {
+        return predicate();
+      }
+    }
+    return true;
+  }
+
+  // Wake up the longest waiting thread, if any.
+  void Signal();
+
+  // Wake up all waiting threads.
+  void Broadcast();
+
+private:
+  SpinLock lock_{};
+  WaitList waiters_{};
+}; // class CondVar
+
+// Counting semaphore. Units released while threads are waiting go straight to
+// them, in order.
+class Semaphore {
+public:
+  explicit Semaphore(size_t count = 0) : count_{count} {}
+  Semaphore(Semaphore const &) = delete;
+  Semaphore &operator=(Semaphore const &) = delete;
+
+  // Take a unit, blocking until there is one.
+  void Acquire();
+
+  // Take a unit if there is one, without blocking.
+  bool TryAcquire();
+
+  // Take a unit, blocking until there is one, but no longer than until
+  // `deadline`, or for `timeout`. Returns false if the time ran out.
+  bool TryAcquireUntil(Deadline deadline);
+  bool TryAcquireFor(std::chrono::nanoseconds timeout) {
+    return TryAcquireUntil(Clock::now() + timeout);
+  }
+
+  // Give back `n` units.
+  void Release(size_t n = 1);
+
+  // Give back a unit, and if a thread was waiting for one, switch to it right
+  // away instead of letting it wait its turn. The current thread runs again
+  // as soon as that thread yields or blocks.
+  void ReleaseAndSwitch();
+
+private:
+  SpinLock lock_{};
+  size_t count_;
+  WaitList waiters_{};
+}; // class Semaphore
+
+} // namespace chloros
+
+#endif // CHLOROS_INCLUDE_SYNC_H_
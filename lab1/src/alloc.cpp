@@ -0,0 +1,241 @@
+#include "alloc.h"
+#include "chloros.h"
+#include "common.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace chloros {
+
+namespace {
+
+// Control blocks are padded to a cache line, so that threads running on
+// different kernel threads never share one.
+constexpr size_t const kCacheLine{64};
+constexpr size_t const kThreadBlockSize{(sizeof(Thread) + kCacheLine - 1) /
+                                        kCacheLine * kCacheLine};
+
+// Number of control blocks carved out of one allocation when a slab runs dry.
+constexpr size_t const kThreadBlocksPerChunk{64};
+
+// One size class per power of two from `kMinStackSize` to `kMaxStackSize`.
+constexpr int const kStackClasses{
+    __builtin_ctzll(kMaxStackSize) - __builtin_ctzll(kMinStackSize) + 1};
+
+size_t const kPageSize{static_cast<size_t>(sysconf(_SC_PAGESIZE))};
+
+// Free stacks and free control blocks are linked through their own memory.
+// For stacks the link lives in the topmost word, which is committed anyway;
+// the bottom of a stack may never have been touched.
+struct FreeNode {
+  FreeNode *next;
+};
+
+// Caches of one kernel thread. This is plain data, so it stays valid while
+// other thread-local destructors run. Those may still free threads, so once
+// `released` is set everything bypasses the caches. Stacks are cached by
+// whether they have a guard page, then by size class.
+struct LocalCache {
+  FreeNode *stacks[2][kStackClasses];
+  size_t num_stacks[2][kStackClasses];
+  FreeNode *blocks;
+  bool released;
+};
+
+thread_local LocalCache local_cache{};
+
+std::atomic<size_t> stack_cache_limit{kDefaultStackCacheLimit};
+
+// Control blocks never go back to malloc. The ones cached by kernel threads
+// that exited end up here for others to pick up.
+std::mutex global_blocks_lock{};
+FreeNode *global_blocks{nullptr};
+
+void PushGlobalBlocks(FreeNode *head, FreeNode *tail) {
+  std::lock_guard<std::mutex> lock{global_blocks_lock};
+  tail->next = global_blocks;
+  global_blocks = head;
+}
+
+int StackClass(size_t size) {
+  return __builtin_ctzll(size) - __builtin_ctzll(kMinStackSize);
+}
+
+FreeNode *StackNode(uint8_t *stack, size_t size) {
+  return reinterpret_cast<FreeNode *>(stack + size) - 1;
+}
+
+uint8_t *NodeStack(FreeNode *node, size_t size) {
+  return reinterpret_cast<uint8_t *>(node + 1) - size;
+}
+
+void UnmapStack(uint8_t *stack, size_t size, bool guard_page) {
+  size_t guard = guard_page ? kPageSize : 0;
+  ASSERT(munmap(stack - guard, size + guard) == 0, "Cannot unmap stack: %s",
+         strerror(errno));
+}
+
+// Drop cached stacks of one kind until at most `limit` are left.
+void TrimStacks(LocalCache &cache, bool guard_page, int size_class,
+                size_t limit) {
+  size_t size = kMinStackSize << size_class;
+  FreeNode *&stacks = cache.stacks[guard_page][size_class];
+  size_t &num_stacks = cache.num_stacks[guard_page][size_class];
+  while (num_stacks > limit) {
+    FreeNode *node = stacks;
+    stacks = node->next;
+    --num_stacks;
+    UnmapStack(NodeStack(node, size), size, guard_page);
+  }
+}
+
+// Number of free stacks of `size` bytes to keep, given a limit for stacks of
+// the default size. Smaller stacks are kept in proportionally larger numbers,
+// so that the cache reserves about as much address space for every size, and
+// threads with small stacks that come and go by the thousand do not end up
+// mapping and unmapping their stacks every time.
+size_t StackCacheLimit(size_t limit, size_t size) {
+  return size < kDefaultStackSize ? limit * (kDefaultStackSize / size) : limit;
+}
+
+void TrimAllStacks(LocalCache &cache, size_t limit) {
+  for (int guard_page = 0; guard_page < 2; ++guard_page) {
+    for (int size_class = 0; size_class < kStackClasses; ++size_class) {
+      TrimStacks(cache, guard_page, size_class,
+                 StackCacheLimit(limit, kMinStackSize << size_class));
+    }
+  }
+}
+
+void ReleaseLocalCache() {
+  LocalCache &cache = local_cache;
+  cache.released = true;
+  TrimAllStacks(cache, 0);
+  if (cache.blocks != nullptr) {
+    FreeNode *tail = cache.blocks;
+    while (tail->next != nullptr) {
+      tail = tail->next;
+    }
+    PushGlobalBlocks(cache.blocks, tail);
+    cache.blocks = nullptr;
+  }
+}
+
+// Empties the caches when the kernel thread exits. It is only constructed once
+// a kernel thread caches something.
+struct LocalCacheReleaser {
+  ~LocalCacheReleaser() { ReleaseLocalCache(); }
+};
+
+thread_local LocalCacheReleaser local_cache_releaser{};
+
+void RefillThreadBlocks(LocalCache &cache) {
+  {
+    std::lock_guard<std::mutex> lock{global_blocks_lock};
+    cache.blocks = global_blocks;
+    global_blocks = nullptr;
+  }
+  if (cache.blocks == nullptr) {
+    auto chunk = static_cast<uint8_t *>(NOT_NULL(
+        aligned_alloc(kCacheLine, kThreadBlockSize * kThreadBlocksPerChunk)));
+    for (size_t i = kThreadBlocksPerChunk; i-- > 0;) {
+      auto node = reinterpret_cast<FreeNode *>(chunk + i * kThreadBlockSize);
+      node->next = cache.blocks;
+      cache.blocks = node;
+    }
+  }
+  if (!cache.released) {
+    (void)&local_cache_releaser;
+  }
+}
+
+} // anonymous namespace
+
+size_t RoundStackSize(size_t size) {
+  ASSERT(size <= kMaxStackSize, "Stack size %zu is too large.", size);
+  if (size <= kMinStackSize) {
+    return kMinStackSize;
+  }
+  return size_t{1} << (64 - __builtin_clzll(size - 1));
+}
+
+uint8_t *AllocateStack(size_t size, bool guard_page) {
+  LocalCache &cache = local_cache;
+  int size_class = StackClass(size);
+  FreeNode *&stacks = cache.stacks[guard_page][size_class];
+  if (stacks != nullptr) {
+    FreeNode *node = stacks;
+    stacks = node->next;
+    --cache.num_stacks[guard_page][size_class];
+    return NodeStack(node, size);
+  }
+  // Reserve address space only. Pages get committed as the stack grows into
+  // them, so a deep stack costs nothing until it is used.
+  size_t guard = guard_page ? kPageSize : 0;
+  void *memory = mmap(nullptr, size + guard, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK,
+                      -1, 0);
+  ASSERT(memory != MAP_FAILED, "Cannot map stack: %s", strerror(errno));
+  // Huge pages would commit memory in 2 MB steps, and throw off the stack
+  // high-water marks we measure page by page.
+  madvise(memory, size + guard, MADV_NOHUGEPAGE);
+  if (guard_page) {
+    ASSERT(mprotect(memory, guard, PROT_NONE) == 0,
+           "Cannot protect guard page: %s", strerror(errno));
+  }
+  return static_cast<uint8_t *>(memory) + guard;
+}
+
+void FreeStack(uint8_t *stack, size_t size, bool guard_page) {
+  LocalCache &cache = local_cache;
+  int size_class = StackClass(size);
+  size_t &num_stacks = cache.num_stacks[guard_page][size_class];
+  if (!cache.released &&
+      num_stacks < StackCacheLimit(
+                       stack_cache_limit.load(std::memory_order_relaxed),
+                       size)) {
+    (void)&local_cache_releaser;
+    FreeNode *node = StackNode(stack, size);
+    node->next = cache.stacks[guard_page][size_class];
+    cache.stacks[guard_page][size_class] = node;
+    ++num_stacks;
+    return;
+  }
+  UnmapStack(stack, size, guard_page);
+}
+
+void *AllocateThreadBlock(size_t size) {
+  ASSERT(size <= kThreadBlockSize, "Thread block too small.");
+  LocalCache &cache = local_cache;
+  if (UNLIKELY(cache.blocks == nullptr)) {
+    RefillThreadBlocks(cache);
+  }
+  FreeNode *node = cache.blocks;
+  cache.blocks = node->next;
+  return node;
+}
+
+void FreeThreadBlock(void *block) {
+  LocalCache &cache = local_cache;
+  auto node = static_cast<FreeNode *>(block);
+  if (UNLIKELY(cache.released)) {
+    PushGlobalBlocks(node, node);
+    return;
+  }
+  node->next = cache.blocks;
+  cache.blocks = node;
+}
+
+void SetStackCacheLimit(size_t stacks) {
+  NoPreemptGuard guard{};
+  stack_cache_limit.store(stacks, std::memory_order_relaxed);
+  // Trim our own cache right away; other kernel threads stop caching once they
+  // are over the limit.
+  TrimAllStacks(local_cache, stacks);
+}
+
+} // namespace chloros
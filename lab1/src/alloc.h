@@ -0,0 +1,38 @@
+#ifndef CHLOROS_SRC_ALLOC_H_
+#define CHLOROS_SRC_ALLOC_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace chloros {
+
+// Stack sizes are rounded up to a power of two between these.
+constexpr size_t const kMinStackSize{1 << 14};
+constexpr size_t const kMaxStackSize{1 << 30};
+
+// Default number of free stacks of the default size each kernel thread keeps
+// around for reuse. See `SetStackCacheLimit`.
+constexpr size_t const kDefaultStackCacheLimit{16};
+
+// Round a requested stack size up to one we actually allocate.
+size_t RoundStackSize(size_t size);
+
+// Get a stack of `size` bytes, which must already be rounded, preferably one
+// recycled on this kernel thread. Memory is only committed as it is touched.
+// With `guard_page`, the page right below the stack is inaccessible. Returns
+// the lowest usable address.
+uint8_t *AllocateStack(size_t size, bool guard_page);
+
+// Give a stack back. It is cached on the calling kernel thread unless the
+// cache for its size is already at its limit.
+void FreeStack(uint8_t *stack, size_t size, bool guard_page);
+
+// Get a block for a `Thread` control block from this kernel thread's slab.
+void *AllocateThreadBlock(size_t size);
+
+// Put a control block back on this kernel thread's slab.
+void FreeThreadBlock(void *block);
+
+} // namespace chloros
+
+#endif // CHLOROS_SRC_ALLOC_H_
@@ -0,0 +1,320 @@
+#include "channel.h"
+#include "chloros.h"
+#include "common.h"
+#include "scheduler.h"
+#include "timer.h"
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace chloros {
+
+namespace {
+
+ChannelOp *OpOf(Waiter *waiter) {
+  return static_cast<ChannelOp *>(waiter->data);
+}
+
+// A blocked `Select` with a deadline. It lives on the stack of its thread.
+struct SelectTimeout {
+  SelectGroup *group;
+  Thread *thread;
+};
+
+// Gives up on a blocked `Select`, unless a channel picked a case first.
+void TimeOutSelect(Timer *timer) {
+  auto timeout = static_cast<SelectTimeout *>(timer->data);
+  SelectGroup *group = timeout->group;
+  int expected = -1;
+  if (!group->selected.compare_exchange_strong(expected,
+                                               SelectGroup::kTimedOut,
+                                               std::memory_order_acq_rel)) {
+    return;
+  }
+  Thread *thread = timeout->thread;
+  group->lock.lock();
+  group->lock.unlock();
+  Unpark(thread);
+}
+
+} // anonymous namespace
+
+void ChannelBase::Close() {
+  WaitList waiters{};
+  lock_.lock();
+  closed_ = true;
+  // Nobody is waiting on both lists at once, so there is no order to keep.
+  while (Waiter *waiter = Claim(receivers_)) {
+    waiters.push_back(waiter);
+  }
+  while (Waiter *waiter = Claim(senders_)) {
+    waiters.push_back(waiter);
+  }
+  lock_.unlock();
+  while (Waiter *waiter = waiters.pop_front()) {
+    OpOf(waiter)->ok = false;
+    Wake(waiter, false);
+  }
+}
+
+bool ChannelBase::closed() {
+  std::lock_guard<SpinLock> lock{lock_};
+  return closed_;
+}
+
+size_t ChannelBase::size() {
+  std::lock_guard<SpinLock> lock{lock_};
+  return size_;
+}
+
+ChannelBase::Result ChannelBase::TrySendLocked(void *value, Waiter **wake) {
+  if (closed_) {
+    return Result::kClosed;
+  }
+  // Someone waiting to receive means the buffer is empty, so the value can
+  // skip it.
+  if (Waiter *receiver = Claim(receivers_)) {
+    ChannelOp *op = OpOf(receiver);
+    MoveValue(value, op->value);
+    op->ok = true;
+    *wake = receiver;
+    return Result::kDone;
+  }
+  if (size_ < capacity_) {
+    PushValue(value);
+    ++size_;
+    return Result::kDone;
+  }
+  return Result::kWouldBlock;
+}
+
+ChannelBase::Result ChannelBase::TryReceiveLocked(void *value, Waiter **wake) {
+  if (size_ > 0) {
+    PopValue(value);
+    --size_;
+    // Now there is room for the value of the first blocked sender.
+    if (Waiter *sender = Claim(senders_)) {
+      ChannelOp *op = OpOf(sender);
+      PushValue(op->value);
+      ++size_;
+      op->ok = true;
+      *wake = sender;
+    }
+    return Result::kDone;
+  }
+  // Without a buffer, values go from sender to receiver directly.
+  if (Waiter *sender = Claim(senders_)) {
+    ChannelOp *op = OpOf(sender);
+    MoveValue(op->value, value);
+    op->ok = true;
+    *wake = sender;
+    return Result::kDone;
+  }
+  return closed_ ? Result::kClosed : Result::kWouldBlock;
+}
+
+Waiter *ChannelBase::Claim(WaitList &waiters) {
+  while (Waiter *waiter = waiters.pop_front()) {
+    ChannelOp *op = OpOf(waiter);
+    int expected = -1;
+    if (op->group == nullptr ||
+        op->group->selected.compare_exchange_strong(
+            expected, op->index, std::memory_order_acq_rel)) {
+      return waiter;
+    }
+  }
+  return nullptr;
+}
+
+void ChannelBase::Wake(Waiter *waiter, bool switch_to) {
+  Thread *thread = waiter->thread;
+  SelectGroup *group = OpOf(waiter)->group;
+  if (group != nullptr) {
+    // The selecting thread may not have been switched out yet.
+    group->lock.lock();
+    group->lock.unlock();
+  }
+  // From here on the waiter may be gone along with the stack of its thread.
+  if (switch_to) {
+    UnparkAndSwitch(thread);
+  } else {
+    Unpark(thread);
+  }
+}
+
+bool ChannelBase::Send(void *value, Deadline deadline) {
+  Waiter *wake = nullptr;
+  lock_.lock();
+  Result result = TrySendLocked(value, &wake);
+  if (result == Result::kWouldBlock) {
+    ChannelOp op{};
+    op.value = value;
+    Waiter waiter{};
+    waiter.thread = CurrentThread();
+    waiter.data = &op;
+    senders_.push_back(&waiter);
+    // Whoever takes the value wakes us up.
+    if (deadline == Deadline::max()) {
+      Park(lock_);
+    } else if (!ParkUntil(lock_, senders_, &waiter, deadline)) {
+      return false;
+    }
+    return op.ok;
+  }
+  lock_.unlock();
+  if (wake != nullptr) {
+    Wake(wake, true);
+  }
+  return result == Result::kDone;
+}
+
+bool ChannelBase::Receive(void *value, Deadline deadline) {
+  Waiter *wake = nullptr;
+  lock_.lock();
+  Result result = TryReceiveLocked(value, &wake);
+  if (result == Result::kWouldBlock) {
+    ChannelOp op{};
+    op.value = value;
+    Waiter waiter{};
+    waiter.thread = CurrentThread();
+    waiter.data = &op;
+    receivers_.push_back(&waiter);
+    // Whoever sends us a value wakes us up.
+    if (deadline == Deadline::max()) {
+      Park(lock_);
+    } else if (!ParkUntil(lock_, receivers_, &waiter, deadline)) {
+      return false;
+    }
+    return op.ok;
+  }
+  lock_.unlock();
+  // A sender that was blocked only needs to get going again, there is no
+  // reason to hurry.
+  if (wake != nullptr) {
+    Wake(wake, false);
+  }
+  return result == Result::kDone;
+}
+
+bool ChannelBase::TrySend(void *value) {
+  Waiter *wake = nullptr;
+  lock_.lock();
+  Result result = TrySendLocked(value, &wake);
+  lock_.unlock();
+  if (wake != nullptr) {
+    Wake(wake, true);
+  }
+  return result == Result::kDone;
+}
+
+bool ChannelBase::TryReceive(void *value) {
+  Waiter *wake = nullptr;
+  lock_.lock();
+  Result result = TryReceiveLocked(value, &wake);
+  lock_.unlock();
+  if (wake != nullptr) {
+    Wake(wake, false);
+  }
+  return result == Result::kDone;
+}
+
+int Select::AddCase(ChannelBase *channel, bool send, void *value) {
+  cases_.push_back(Case{channel, send, value});
+  return static_cast<int>(cases_.size()) - 1;
+}
+
+int Select::Wait() { return Run(true, Deadline::max()); }
+
+int Select::WaitUntil(Deadline deadline) { return Run(true, deadline); }
+
+int Select::TryWait() { return Run(false, Deadline::max()); }
+
+int Select::Run(bool block, Deadline deadline) {
+  ASSERT(!cases_.empty(), "Nothing to select.");
+  // Lock every channel involved, always in the same order, so that concurrent
+  // selects cannot deadlock.
+  std::vector<ChannelBase *> channels{};
+  for (auto &&c : cases_) {
+    channels.push_back(c.channel);
+  }
+  std::sort(channels.begin(), channels.end());
+  channels.erase(std::unique(channels.begin(), channels.end()), channels.end());
+  for (ChannelBase *channel : channels) {
+    channel->lock_.lock();
+  }
+  auto unlock_all = [&channels] {
+    for (ChannelBase *channel : channels) {
+      channel->lock_.unlock();
+    }
+  };
+
+  for (size_t i = 0; i < cases_.size(); ++i) {
+    Case &c = cases_[i];
+    Waiter *wake = nullptr;
+    ChannelBase::Result result =
+        c.send ? c.channel->TrySendLocked(c.value, &wake)
+               : c.channel->TryReceiveLocked(c.value, &wake);
+    if (result != ChannelBase::Result::kWouldBlock) {
+      unlock_all();
+      if (wake != nullptr) {
+        ChannelBase::Wake(wake, c.send);
+      }
+      ok_ = result == ChannelBase::Result::kDone;
+      return static_cast<int>(i);
+    }
+  }
+  if (!block || deadline <= Clock::now()) {
+    unlock_all();
+    return -1;
+  }
+
+  // Wait on all of them. The first channel to claim the group decides which
+  // case is done, and wakes us up.
+  SelectGroup group{};
+  std::vector<ChannelOp> ops(cases_.size());
+  std::vector<Waiter> waiters(cases_.size());
+  Thread *self = CurrentThread();
+  for (size_t i = 0; i < cases_.size(); ++i) {
+    Case &c = cases_[i];
+    ops[i].group = &group;
+    ops[i].index = static_cast<int>(i);
+    ops[i].value = c.value;
+    waiters[i].thread = self;
+    waiters[i].data = &ops[i];
+    (c.send ? c.channel->senders_ : c.channel->receivers_)
+        .push_back(&waiters[i]);
+  }
+  group.lock.lock();
+  unlock_all();
+  SelectTimeout timeout{&group, self};
+  Timer timer{};
+  if (deadline != Deadline::max()) {
+    timer.fire = TimeOutSelect;
+    timer.data = &timeout;
+    StartTimer(&timer, deadline);
+  }
+  Park(group.lock);
+  if (timer.wheel != nullptr) {
+    timer.wheel->Stop(&timer);
+  }
+
+  // Take our waiters off the lists of the cases that were not picked.
+  int selected = group.selected.load(std::memory_order_acquire);
+  ASSERT(selected != -1, "Woken up without a case picked.");
+  for (size_t i = 0; i < cases_.size(); ++i) {
+    Case &c = cases_[i];
+    std::lock_guard<SpinLock> lock{c.channel->lock_};
+    WaitList &list = c.send ? c.channel->senders_ : c.channel->receivers_;
+    if (list.contains(&waiters[i])) {
+      list.remove(&waiters[i]);
+    }
+  }
+  if (selected == SelectGroup::kTimedOut) {
+    ok_ = false;
+    return -1;
+  }
+  ok_ = ops[selected].ok;
+  return selected;
+}
+
+} // namespace chloros
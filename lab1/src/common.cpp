@@ -92,7 +92,7 @@ void AssertFail(char const *file, int line, char const *func, char const *expr,
     msg.append("\nextra message: ");
     std::va_list ap;
     va_start(ap, fmt);
-    msg.append(FormatString(fmt, ap));
+    msg.append(FormatStringVariadic(fmt, ap));
     va_end(ap);
   }
   throw AssertionError{msg};
@@ -0,0 +1,695 @@
+#include "io.h"
+#include "chloros.h"
+#include "common.h"
+#include "reactor.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "uring.h"
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+namespace chloros {
+
+namespace {
+
+// Most events handled per `epoll_wait`.
+constexpr int const kMaxEvents{256};
+
+// Submission queue size of each kernel thread's io_uring.
+constexpr unsigned const kRingEntries{256};
+
+// Number of helper threads for file I/O without io_uring.
+constexpr int const kHelperThreads{4};
+
+std::atomic<bool> uring_enabled{true};
+
+// Whether sockets that would block go to io_uring too, see `SetUringSockets`.
+std::atomic<bool> uring_sockets{false};
+
+std::atomic<uint64_t> file_operations{0};
+std::atomic<uint64_t> file_system_calls{0};
+
+void CountSystemCalls(uint64_t n) {
+  file_system_calls.fetch_add(n, std::memory_order_relaxed);
+}
+
+// Threads waiting for one file descriptor on one kernel thread.
+struct FdWaiters {
+  Thread *reader;
+  Thread *writer;
+  // Whether the descriptor is in the epoll instance, armed or not.
+  bool registered;
+};
+
+// Per-kernel-thread epoll instance, and who is waiting for what. It is only
+// ever used by its own kernel thread: a thread registers on the kernel thread
+// it runs on before it parks, and is woken up by that same kernel thread
+// polling, so none of this is locked. Descriptors are registered one-shot, so
+// nothing is reported for them until a thread waits for them again.
+struct Reactor {
+  int epoll{-1};
+  // Number of threads parked in here, waiting for a descriptor or for their
+  // operation on `ring` to complete.
+  int waiters{0};
+  // Indexed by file descriptor.
+  std::vector<FdWaiters> fds{};
+  // Set up on first use. Its descriptor is in `epoll`, so that polling for
+  // descriptors also picks up completions.
+  Ring ring{};
+  bool ring_tried{false};
+  // Operations submitted to `ring`, or queued for submission, that have not
+  // been reaped yet. Kept below what the completion queue holds.
+  unsigned in_flight{0};
+  // Operations handed to helper threads, which is the only thing in here
+  // other kernel threads touch. A helper that is done with one wakes up its
+  // thread, then rings `doorbell`, which is in `epoll` as well, so that we do
+  // not sleep through it. Peers ring it too, to hand us something to do.
+  std::atomic<int> helper_ops{0};
+  int doorbell{-1};
+  // Held while a thread parks. Nobody else needs it, since the thread cannot
+  // be woken up before its kernel thread polls.
+  SpinLock lock{};
+  // Next reactor in `free_reactors`.
+  Reactor *next_free{nullptr};
+};
+
+// Reactors are never freed, since a helper may still ring the doorbell of one
+// whose kernel thread has exited. The next kernel thread to need one takes it
+// over, epoll instance, ring and all. Nothing is waiting in them by then.
+std::mutex free_reactors_lock{};
+Reactor *free_reactors{nullptr};
+
+thread_local Reactor *local_reactor{nullptr};
+
+// Gives the reactor back when the kernel thread exits. By then, `Wait` has
+// seen every parked thread woken up.
+struct ReactorReleaser {
+  ~ReactorReleaser() {
+    if (local_reactor != nullptr) {
+      std::lock_guard<std::mutex> lock{free_reactors_lock};
+      local_reactor->next_free = free_reactors;
+      free_reactors = local_reactor;
+      local_reactor = nullptr;
+    }
+  }
+};
+
+thread_local ReactorReleaser reactor_releaser{};
+
+Reactor &LocalReactor() {
+  if (UNLIKELY(local_reactor == nullptr)) {
+    (void)&reactor_releaser;
+    {
+      std::lock_guard<std::mutex> lock{free_reactors_lock};
+      local_reactor = free_reactors;
+      if (local_reactor != nullptr) {
+        free_reactors = local_reactor->next_free;
+        return *local_reactor;
+      }
+    }
+    auto reactor = new Reactor{};
+    reactor->epoll = epoll_create1(EPOLL_CLOEXEC);
+    ASSERT(reactor->epoll >= 0, "Cannot create epoll instance: %s",
+           strerror(errno));
+    reactor->doorbell = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    ASSERT(reactor->doorbell >= 0, "Cannot create eventfd: %s",
+           strerror(errno));
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = reactor->doorbell;
+    ASSERT(epoll_ctl(reactor->epoll, EPOLL_CTL_ADD, reactor->doorbell,
+                     &event) == 0,
+           "Cannot watch eventfd: %s", strerror(errno));
+    local_reactor = reactor;
+  }
+  return *local_reactor;
+}
+
+// Tell epoll about whatever the threads waiting on `fd` are waiting for.
+void Arm(Reactor &reactor, int fd, FdWaiters &waiters) {
+  epoll_event event{};
+  event.events = EPOLLONESHOT;
+  if (waiters.reader != nullptr) {
+    event.events |= EPOLLIN;
+  }
+  if (waiters.writer != nullptr) {
+    event.events |= EPOLLOUT;
+  }
+  event.data.fd = fd;
+  // A descriptor that was closed since is gone from the epoll instance, and a
+  // new one with the same number is not in it yet.
+  int op = waiters.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+  int result = epoll_ctl(reactor.epoll, op, fd, &event);
+  if (result != 0 && (errno == ENOENT || errno == EEXIST)) {
+    op = op == EPOLL_CTL_MOD ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    result = epoll_ctl(reactor.epoll, op, fd, &event);
+  }
+  ASSERT(result == 0, "Cannot watch fd %d: %s", fd, strerror(errno));
+  waiters.registered = true;
+}
+
+// A thread in `WaitFor` with a deadline. It lives on the stack of that
+// thread.
+struct FdTimeout {
+  Reactor *reactor;
+  int fd;
+  bool write;
+  Thread *thread;
+  bool timed_out;
+};
+
+// The timer fires on the kernel thread of the reactor, so it cannot race with
+// the descriptor becoming ready.
+void TimeOutFd(Timer *timer) {
+  auto timeout = static_cast<FdTimeout *>(timer->data);
+  FdWaiters &waiters = timeout->reactor->fds[timeout->fd];
+  Thread *&slot = timeout->write ? waiters.writer : waiters.reader;
+  // Once the descriptor woke the thread up, another one may be waiting for it
+  // already.
+  if (slot != timeout->thread) {
+    return;
+  }
+  slot = nullptr;
+  --timeout->reactor->waiters;
+  timeout->timed_out = true;
+  // It stays armed for whoever waits for it next.
+  Unpark(timeout->thread);
+}
+
+bool WaitFor(int fd, bool write, Deadline deadline) {
+  NoPreemptGuard guard{};
+  ASSERT(fd >= 0, "Invalid fd %d.", fd);
+  if (deadline <= Clock::now()) {
+    return false;
+  }
+  Reactor &reactor = LocalReactor();
+  if (static_cast<size_t>(fd) >= reactor.fds.size()) {
+    reactor.fds.resize(fd + 1, FdWaiters{});
+  }
+  FdWaiters &waiters = reactor.fds[fd];
+  Thread *&slot = write ? waiters.writer : waiters.reader;
+  ASSERT(slot == nullptr, "Another thread is waiting on fd %d already.", fd);
+  slot = CurrentThread();
+  Arm(reactor, fd, waiters);
+  ++reactor.waiters;
+  FdTimeout timeout{&reactor, fd, write, slot, false};
+  Timer timer{};
+  if (deadline != Deadline::max()) {
+    timer.fire = TimeOutFd;
+    timer.data = &timeout;
+    StartTimer(&timer, deadline);
+  }
+  reactor.lock.lock();
+  // We may resume on another kernel thread.
+  Park(reactor.lock);
+  if (timer.wheel != nullptr) {
+    timer.wheel->Stop(&timer);
+  }
+  return !timeout.timed_out;
+}
+
+bool WouldBlock(int error) { return error == EAGAIN || error == EWOULDBLOCK; }
+
+void SetNonBlocking(int fd) {
+  int flags = fcntl(fd, F_GETFL);
+  if (flags >= 0 && !(flags & O_NONBLOCK)) {
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+  }
+}
+
+// Sockets can be asked not to block call by call, which saves a system call.
+// Everything else is put into non-blocking mode for good. Sets `socket` to
+// whether `fd` turned out to be one.
+ssize_t TryRead(int fd, void *buffer, size_t size, bool *socket) {
+  ssize_t n = recv(fd, buffer, size, MSG_DONTWAIT);
+  *socket = !(n < 0 && errno == ENOTSOCK);
+  if (!*socket) {
+    SetNonBlocking(fd);
+    n = read(fd, buffer, size);
+  }
+  return n;
+}
+
+ssize_t TryWrite(int fd, void const *buffer, size_t size, bool *socket) {
+  ssize_t n = send(fd, buffer, size, MSG_DONTWAIT);
+  *socket = !(n < 0 && errno == ENOTSOCK);
+  if (!*socket) {
+    SetNonBlocking(fd);
+    n = write(fd, buffer, size);
+  }
+  return n;
+}
+
+// A file operation waiting for its completion. It lives on the stack of the
+// waiting thread.
+struct FileOp {
+  Thread *thread;
+  int32_t result;
+};
+
+// Make the threads whose operations completed ready again. Returns how many.
+int ReapCompletions(Reactor &reactor) {
+  int reaped = 0;
+  reactor.ring.Reap([&](uint64_t user_data, int32_t result) {
+    auto op = reinterpret_cast<FileOp *>(user_data);
+    op->result = result;
+    --reactor.in_flight;
+    --reactor.waiters;
+    ++reaped;
+    Unpark(op->thread);
+  });
+  return reaped;
+}
+
+// Get this kernel thread's ring, if it can have one.
+Ring *LocalRing(Reactor &reactor) {
+  if (UNLIKELY(!reactor.ring_tried)) {
+    reactor.ring_tried = true;
+    if (reactor.ring.Init(kRingEntries)) {
+      // Level-triggered, so completions are reported until they are reaped.
+      epoll_event event{};
+      event.events = EPOLLIN;
+      event.data.fd = reactor.ring.fd();
+      ASSERT(epoll_ctl(reactor.epoll, EPOLL_CTL_ADD, reactor.ring.fd(),
+                       &event) == 0,
+             "Cannot watch io_uring: %s", strerror(errno));
+    }
+  }
+  return reactor.ring.ready() ? &reactor.ring : nullptr;
+}
+
+// Queue a read or write on the ring and park until it is done. Returns false
+// if the ring cannot take it, or cannot take more than `limit` operations in
+// flight.
+bool RingReadWrite(bool write, int fd, void *buffer, size_t size,
+                   off_t offset, unsigned limit, ssize_t *result) {
+  NoPreemptGuard guard{};
+  Reactor &reactor = LocalReactor();
+  Ring *ring = LocalRing(reactor);
+  if (ring == nullptr || reactor.in_flight >= limit ||
+      reactor.in_flight >= ring->completion_entries()) {
+    return false;
+  }
+  FileOp op{CurrentThread(), 0};
+  auto length = static_cast<unsigned>(std::min<size_t>(size, 1u << 30));
+  auto user_data = reinterpret_cast<uint64_t>(&op);
+  if (!ring->PrepareReadWrite(write, fd, buffer, length, offset, user_data)) {
+    // The submission queue is full, so submitting now is as batched as it
+    // gets.
+    ring->Submit();
+    CountSystemCalls(1);
+    bool prepared = ring->PrepareReadWrite(write, fd, buffer, length, offset,
+                                           user_data);
+    ASSERT(prepared, "No room in an empty submission queue.");
+  }
+  ++reactor.in_flight;
+  ++reactor.waiters;
+  reactor.lock.lock();
+  // We may resume on another kernel thread.
+  Park(reactor.lock);
+  if (op.result < 0) {
+    errno = -op.result;
+    *result = -1;
+  } else {
+    *result = op.result;
+  }
+  return true;
+}
+
+// A file operation handed to a helper thread. It lives on the stack of the
+// waiting thread.
+struct HelperRequest {
+  bool write;
+  int fd;
+  void *buffer;
+  size_t size;
+  off_t offset;
+  ssize_t result;
+  int error;
+  Thread *thread;
+  // Where the waiting thread parked.
+  Reactor *reactor;
+  // Held by the waiting thread until it is parked.
+  SpinLock lock;
+  HelperRequest *next;
+};
+
+// Queue of requests for the helper threads. The helpers are started on first
+// use and run until the process exits, so the queue is never destroyed either.
+struct Helpers {
+  std::mutex lock{};
+  std::condition_variable cv{};
+  HelperRequest *head{nullptr};
+  HelperRequest *tail{nullptr};
+  int idle{0};
+};
+
+std::once_flag helpers_once{};
+Helpers *helpers{nullptr};
+
+void Helper() {
+  for (;;) {
+    HelperRequest *request;
+    {
+      std::unique_lock<std::mutex> lock{helpers->lock};
+      if (helpers->head == nullptr) {
+        ++helpers->idle;
+        do {
+          helpers->cv.wait(lock);
+        } while (helpers->head == nullptr);
+        CountSystemCalls(1);
+      }
+      request = helpers->head;
+      helpers->head = request->next;
+      if (helpers->head == nullptr) {
+        helpers->tail = nullptr;
+      }
+    }
+    if (request->write) {
+      request->result =
+          pwrite(request->fd, request->buffer, request->size, request->offset);
+    } else {
+      request->result =
+          pread(request->fd, request->buffer, request->size, request->offset);
+    }
+    request->error = errno;
+    CountSystemCalls(1);
+    // Once we get the lock, the thread is parked. The request is gone as soon
+    // as it is woken up.
+    Thread *thread = request->thread;
+    Reactor *reactor = request->reactor;
+    request->lock.lock();
+    request->lock.unlock();
+    Unpark(thread);
+    reactor->helper_ops.fetch_sub(1, std::memory_order_release);
+    eventfd_write(reactor->doorbell, 1);
+    CountSystemCalls(1);
+  }
+}
+
+void StartHelpers() {
+  helpers = new Helpers{};
+  for (int i = 0; i < kHelperThreads; ++i) {
+    std::thread{Helper}.detach();
+  }
+}
+
+ssize_t HelperReadWrite(bool write, int fd, void *buffer, size_t size,
+                        off_t offset) {
+  std::call_once(helpers_once, StartHelpers);
+  HelperRequest request{write,   fd,      buffer, size,   offset,
+                        0,       0,       nullptr, nullptr, {}, nullptr};
+  // No preemption while we hold `helpers->lock`, or another thread on this
+  // kernel thread might try to take it too.
+  NoPreemptGuard guard{};
+  Reactor &reactor = LocalReactor();
+  reactor.helper_ops.fetch_add(1, std::memory_order_relaxed);
+  request.thread = CurrentThread();
+  request.reactor = &reactor;
+  request.lock.lock();
+  bool wake = false;
+  {
+    std::lock_guard<std::mutex> lock{helpers->lock};
+    if (helpers->tail != nullptr) {
+      helpers->tail->next = &request;
+    } else {
+      helpers->head = &request;
+    }
+    helpers->tail = &request;
+    if (helpers->idle > 0) {
+      --helpers->idle;
+      wake = true;
+    }
+  }
+  if (wake) {
+    helpers->cv.notify_one();
+    CountSystemCalls(1);
+  }
+  Park(request.lock);
+  errno = request.error;
+  return request.result;
+}
+
+ssize_t FileReadWrite(bool write, int fd, void *buffer, size_t size,
+                      off_t offset) {
+  file_operations.fetch_add(1, std::memory_order_relaxed);
+  ssize_t result;
+  if (uring_enabled.load(std::memory_order_relaxed) &&
+      RingReadWrite(write, fd, buffer, size, offset, ~0u, &result)) {
+    return result;
+  }
+  return HelperReadWrite(write, fd, buffer, size, offset);
+}
+
+// Read from or write to a socket that would block through the ring, which
+// waits for the socket and then does the transfer, in place of arming epoll,
+// waiting and trying again. Returns false, with `errno` left alone, if it
+// cannot, in which case the caller waits with epoll instead. A socket may wait
+// for a long time, so sockets only get half of the ring, leaving the rest to
+// files.
+bool SocketReadWrite(bool write, int fd, void *buffer, size_t size,
+                     ssize_t *result) {
+  if (!uring_enabled.load(std::memory_order_relaxed) ||
+      !uring_sockets.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  int error = errno;
+  // An offset of -1 means the current position, which sockets do not have.
+  if (!RingReadWrite(write, fd, buffer, size, -1, kRingEntries, result)) {
+    errno = error;
+    return false;
+  }
+  // Older kernels fail on non-blocking sockets rather than wait for them.
+  if (*result < 0 && WouldBlock(errno)) {
+    uring_sockets.store(false, std::memory_order_relaxed);
+    return false;
+  }
+  return true;
+}
+
+// `epoll_wait` with a timeout to the nanosecond where the kernel has
+// `epoll_pwait2`, and rounded up to the millisecond elsewhere.
+int Poll(int epoll, epoll_event *events, std::chrono::nanoseconds timeout) {
+  static std::atomic<bool> have_pwait2{true};
+  if (timeout.count() > 0 && have_pwait2.load(std::memory_order_relaxed)) {
+    timespec duration{
+        static_cast<time_t>(timeout.count() / 1000000000),
+        static_cast<long>(timeout.count() % 1000000000)};
+    int n = epoll_pwait2(epoll, events, kMaxEvents, &duration, nullptr);
+    if (n >= 0 || errno != ENOSYS) {
+      return n;
+    }
+    have_pwait2.store(false, std::memory_order_relaxed);
+  }
+  int timeout_ms =
+      timeout.count() < 0
+          ? -1
+          : static_cast<int>((timeout.count() + 999999) / 1000000);
+  return epoll_wait(epoll, events, kMaxEvents, timeout_ms);
+}
+
+} // anonymous namespace
+
+bool WaitingForIo() {
+  Reactor *reactor = local_reactor;
+  return reactor != nullptr &&
+         (reactor->waiters > 0 ||
+          reactor->helper_ops.load(std::memory_order_acquire) > 0);
+}
+
+int LocalDoorbell() { return LocalReactor().doorbell; }
+
+void RingDoorbell(int doorbell) { eventfd_write(doorbell, 1); }
+
+bool PollIo(std::chrono::nanoseconds timeout) {
+  if (!WaitingForIo()) {
+    return false;
+  }
+  Reactor *reactor = local_reactor;
+  if (reactor->in_flight > 0) {
+    // One system call for everything queued since we last got here.
+    if (reactor->ring.Submit()) {
+      CountSystemCalls(1);
+    }
+    // Reads from the page cache tend to be done by now, in which case there is
+    // no need to wait for anything.
+    if (ReapCompletions(*reactor) > 0) {
+      timeout = std::chrono::nanoseconds{0};
+    }
+    if (reactor->waiters == 0 &&
+        reactor->helper_ops.load(std::memory_order_acquire) == 0) {
+      return true;
+    }
+  }
+  if (reactor->in_flight > 0 ||
+      reactor->helper_ops.load(std::memory_order_relaxed) > 0) {
+    CountSystemCalls(1);
+  }
+  epoll_event events[kMaxEvents];
+  // On failure, most likely an interruption by preemption, there is simply
+  // nothing to do this time.
+  int n = Poll(reactor->epoll, events, timeout);
+  for (int i = 0; i < n; ++i) {
+    int fd = events[i].data.fd;
+    if (fd == reactor->ring.fd()) {
+      ReapCompletions(*reactor);
+      continue;
+    }
+    if (fd == reactor->doorbell) {
+      // Helpers wake up their threads themselves, and peers queue theirs, we
+      // only had to stop waiting.
+      eventfd_t value;
+      eventfd_read(reactor->doorbell, &value);
+      CountSystemCalls(1);
+      continue;
+    }
+    FdWaiters &waiters = reactor->fds[fd];
+    // Errors and hangups wake everybody, so they get to see them.
+    bool error = events[i].events & (EPOLLERR | EPOLLHUP);
+    Thread *ready[2] = {nullptr, nullptr};
+    if (waiters.reader != nullptr && (error || events[i].events & EPOLLIN)) {
+      ready[0] = waiters.reader;
+      waiters.reader = nullptr;
+    }
+    if (waiters.writer != nullptr && (error || events[i].events & EPOLLOUT)) {
+      ready[1] = waiters.writer;
+      waiters.writer = nullptr;
+    }
+    // Keep watching for whoever is still waiting.
+    if (waiters.reader != nullptr || waiters.writer != nullptr) {
+      Arm(*reactor, fd, waiters);
+    }
+    for (Thread *thread : ready) {
+      if (thread != nullptr) {
+        --reactor->waiters;
+        Unpark(thread);
+      }
+    }
+  }
+  return true;
+}
+
+namespace io {
+
+ssize_t Read(int fd, void *buffer, size_t size) {
+  for (;;) {
+    bool socket;
+    ssize_t n = TryRead(fd, buffer, size, &socket);
+    if (n < 0 && WouldBlock(errno) && socket) {
+      SocketReadWrite(false, fd, buffer, size, &n);
+    }
+    if (n >= 0 || (errno != EINTR && !WouldBlock(errno))) {
+      return n;
+    }
+    if (errno != EINTR) {
+      WaitReadable(fd);
+    }
+  }
+}
+
+ssize_t Write(int fd, void const *buffer, size_t size) {
+  auto bytes = static_cast<uint8_t const *>(buffer);
+  size_t written = 0;
+  while (written < size) {
+    bool socket;
+    ssize_t n = TryWrite(fd, bytes + written, size - written, &socket);
+    if (n < 0 && WouldBlock(errno) && socket) {
+      SocketReadWrite(true, fd, const_cast<uint8_t *>(bytes + written),
+                      size - written, &n);
+    }
+    if (n >= 0) {
+      written += n;
+    } else if (WouldBlock(errno)) {
+      WaitWritable(fd);
+    } else if (errno != EINTR) {
+      return written > 0 ? static_cast<ssize_t>(written) : -1;
+    }
+  }
+  return static_cast<ssize_t>(written);
+}
+
+int Accept(int fd, sockaddr *address, socklen_t *length) {
+  SetNonBlocking(fd);
+  for (;;) {
+    int connection = accept4(fd, address, length, SOCK_NONBLOCK);
+    if (connection >= 0 || (errno != EINTR && !WouldBlock(errno))) {
+      return connection;
+    }
+    if (errno != EINTR) {
+      WaitReadable(fd);
+    }
+  }
+}
+
+int Connect(int fd, sockaddr const *address, socklen_t length) {
+  SetNonBlocking(fd);
+  if (connect(fd, address, length) == 0) {
+    return 0;
+  }
+  // An interrupted connect keeps going in the background, just like one that
+  // would block.
+  if (errno != EINPROGRESS && errno != EINTR) {
+    return -1;
+  }
+  WaitWritable(fd);
+  int error = 0;
+  socklen_t error_length = sizeof(error);
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &error_length) != 0) {
+    return -1;
+  }
+  if (error != 0) {
+    errno = error;
+    return -1;
+  }
+  return 0;
+}
+
+void WaitReadable(int fd) { WaitFor(fd, false, Deadline::max()); }
+
+void WaitWritable(int fd) { WaitFor(fd, true, Deadline::max()); }
+
+bool WaitReadable(int fd, Deadline deadline) {
+  return WaitFor(fd, false, deadline);
+}
+
+bool WaitWritable(int fd, Deadline deadline) {
+  return WaitFor(fd, true, deadline);
+}
+
+ssize_t PRead(int fd, void *buffer, size_t size, off_t offset) {
+  return FileReadWrite(false, fd, buffer, size, offset);
+}
+
+ssize_t PWrite(int fd, void const *buffer, size_t size, off_t offset) {
+  return FileReadWrite(true, fd, const_cast<void *>(buffer), size, offset);
+}
+
+void SetUring(bool enabled) {
+  uring_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void SetUringSockets(bool enabled) {
+  uring_sockets.store(enabled, std::memory_order_relaxed);
+}
+
+FileIoStats GetFileIoStats() {
+  FileIoStats stats{};
+  stats.operations = file_operations.load(std::memory_order_relaxed);
+  stats.system_calls = file_system_calls.load(std::memory_order_relaxed);
+  return stats;
+}
+
+} // namespace io
+
+} // namespace chloros
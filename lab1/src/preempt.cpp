@@ -0,0 +1,208 @@
+#include "preempt.h"
+#include "chloros.h"
+#include "common.h"
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <link.h>
+#include <mutex>
+#include <ucontext.h>
+#include <unistd.h>
+
+// The documented name for the thread a `SIGEV_THREAD_ID` event goes to, which
+// older glibc does not define.
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace chloros {
+
+namespace {
+
+// Most executables have one or two executable segments.
+constexpr int const kMaxTextSegments{8};
+
+struct TextSegment {
+  uintptr_t begin;
+  uintptr_t end;
+};
+
+// Executable segments of the program itself. Code outside of them, most
+// importantly the C and C++ runtime, may hold locks or thread-local state that
+// other green threads on the same kernel thread would trip over, so it is never
+// preempted.
+TextSegment text_segments[kMaxTextSegments];
+int num_text_segments{0};
+
+std::once_flag setup_once{};
+
+std::atomic<int64_t> time_slice_us{kDefaultTimeSlice.count()};
+
+// Preemption state of this kernel thread. It is plain data, so the signal
+// handler can use it.
+struct LocalPreemption {
+  // See `PreemptionDisabledDepth`.
+  int disabled_depth;
+  // A preemption came due inside a no-preemption region.
+  bool pending;
+  bool armed;
+  timer_t timer;
+};
+
+// Named so that `DisablePreemption` can reach it from assembly.
+thread_local LocalPreemption local_preemption asm("chloros_local_preemption"){};
+
+int FindTextSegments(dl_phdr_info *info, size_t, void *) {
+  // The program itself comes first.
+  for (int i = 0; i < info->dlpi_phnum; ++i) {
+    ElfW(Phdr) const &header = info->dlpi_phdr[i];
+    if (header.p_type == PT_LOAD && (header.p_flags & PF_X) &&
+        num_text_segments < kMaxTextSegments) {
+      uintptr_t begin = info->dlpi_addr + header.p_vaddr;
+      text_segments[num_text_segments++] = {begin, begin + header.p_memsz};
+    }
+  }
+  return 1;
+}
+
+bool InProgramText(uintptr_t address) {
+  for (int i = 0; i < num_text_segments; ++i) {
+    if (address >= text_segments[i].begin && address < text_segments[i].end) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Kept out of line for the same reason as the scheduler's own thread-local
+// lookups: the running green thread may have moved to another kernel thread
+// since the last one.
+__attribute__((noinline)) LocalPreemption &Local() {
+  LocalPreemption *local = &local_preemption;
+  asm volatile("" : "+r"(local));
+  return *local;
+}
+
+void Preempt() {
+  if (CurrentThread()->is_idle_kernel_thread) {
+    return;
+  }
+  // Only for something that can actually run, not for an initial thread that
+  // is waiting.
+  Yield(true);
+}
+
+void HandlePreemptionSignal(int, siginfo_t *, void *context) {
+  LocalPreemption &local = Local();
+  if (!local.armed) {
+    return;
+  }
+  if (local.disabled_depth > 0) {
+    local.pending = true;
+    return;
+  }
+  // Outside of our own code there is no telling when it is safe, so wait for
+  // the next tick.
+  auto rip = static_cast<ucontext_t *>(context)->uc_mcontext.gregs[REG_RIP];
+  if (!InProgramText(static_cast<uintptr_t>(rip))) {
+    return;
+  }
+  int saved_errno = errno;
+  Preempt();
+  errno = saved_errno;
+}
+
+int PreemptionSignal() { return SIGRTMIN; }
+
+void SetUp() {
+  dl_iterate_phdr(FindTextSegments, nullptr);
+  struct sigaction action {};
+  action.sa_sigaction = HandlePreemptionSignal;
+  // The handler switches to other threads, which must not run with the signal
+  // blocked. Nested signals find the scheduler in a no-preemption region.
+  action.sa_flags = SA_SIGINFO | SA_NODEFER | SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  ASSERT(sigaction(PreemptionSignal(), &action, nullptr) == 0,
+         "Cannot install signal handler: %s", strerror(errno));
+}
+
+} // anonymous namespace
+
+int &PreemptionDisabledDepth() { return Local().disabled_depth; }
+
+void ClearPendingPreemption() { Local().pending = false; }
+
+void StopPreemption() {
+  LocalPreemption &local = Local();
+  if (local.armed) {
+    local.armed = false;
+    timer_delete(local.timer);
+  }
+}
+
+// These two are out of line themselves, and on the path of every lock and
+// every switch, so they use the thread-local state directly.
+void DisablePreemption() {
+  // Until the depth is up, the signal handler may move us to another kernel
+  // thread, so it goes up in one instruction relative to %fs: a load, add and
+  // store would write the old kernel thread's depth plus one to the new one.
+  static_assert(offsetof(LocalPreemption, disabled_depth) == 0,
+                "The depth must be at the start of the local state.");
+  asm volatile("movq chloros_local_preemption@gottpoff(%%rip), %%rax\n\t"
+               "incl %%fs:(%%rax)"
+               :
+               :
+               : "rax", "cc", "memory");
+}
+
+void EnablePreemption() {
+  LocalPreemption &local = local_preemption;
+  ASSERT(local.disabled_depth > 0, "Preemption is not disabled.");
+  if (--local.disabled_depth == 0 && UNLIKELY(local.pending)) {
+    local.pending = false;
+    Preempt();
+  }
+}
+
+void SetPreemption(bool enabled) {
+  NoPreemptGuard guard{};
+  LocalPreemption &local = Local();
+  if (!enabled) {
+    StopPreemption();
+    return;
+  }
+  if (local.armed) {
+    return;
+  }
+  // Fail early if the kernel thread has not called `Initialize`.
+  NOT_NULL(CurrentThread());
+  std::call_once(setup_once, SetUp);
+
+  // The timer measures CPU time of this kernel thread only, so it does not go
+  // off while the kernel thread is not running anyway.
+  sigevent event{};
+  event.sigev_notify = SIGEV_THREAD_ID;
+  event.sigev_signo = PreemptionSignal();
+  event.sigev_notify_thread_id = gettid();
+  ASSERT(timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &local.timer) == 0,
+         "Cannot create timer: %s", strerror(errno));
+  int64_t slice = time_slice_us.load(std::memory_order_relaxed);
+  itimerspec spec{};
+  spec.it_interval.tv_sec = slice / 1000000;
+  spec.it_interval.tv_nsec = slice % 1000000 * 1000;
+  spec.it_value = spec.it_interval;
+  local.armed = true;
+  ASSERT(timer_settime(local.timer, 0, &spec, nullptr) == 0,
+         "Cannot start timer: %s", strerror(errno));
+}
+
+void SetTimeSlice(std::chrono::microseconds slice) {
+  ASSERT(slice.count() > 0, "Time slice must be positive.");
+  time_slice_us.store(slice.count(), std::memory_order_relaxed);
+}
+
+} // namespace chloros
@@ -0,0 +1,19 @@
+#ifndef CHLOROS_SRC_PREEMPT_H_
+#define CHLOROS_SRC_PREEMPT_H_
+
+namespace chloros {
+
+// Depth of the no-preemption regions of whatever runs on this kernel thread
+// right now. It is saved with a green thread when it is switched out, and
+// restored when it is switched back in.
+int &PreemptionDisabledDepth();
+
+// Forget about a preemption that came due, because we are switching anyway.
+void ClearPendingPreemption();
+
+// Turn preemption off for good as this kernel thread goes away.
+void StopPreemption();
+
+} // namespace chloros
+
+#endif // CHLOROS_SRC_PREEMPT_H_
@@ -0,0 +1,26 @@
+#ifndef CHLOROS_SRC_REACTOR_H_
+#define CHLOROS_SRC_REACTOR_H_
+
+#include <chrono>
+
+namespace chloros {
+
+// Look for file descriptors that became ready on this kernel thread, and make
+// the threads waiting for them ready. Waits up to `timeout` for the first one,
+// a negative one meaning forever. Returns false right away if no thread here
+// is waiting for I/O, true otherwise.
+bool PollIo(std::chrono::nanoseconds timeout);
+
+// Whether any thread on this kernel thread is waiting for I/O, so that
+// `PollIo` has something to wait for.
+bool WaitingForIo();
+
+// Eventfd in the epoll set of this kernel thread, which makes `PollIo` return
+// when rung from anywhere, see `RingDoorbell`.
+int LocalDoorbell();
+
+void RingDoorbell(int doorbell);
+
+} // namespace chloros
+
+#endif // CHLOROS_SRC_REACTOR_H_
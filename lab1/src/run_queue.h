@@ -0,0 +1,282 @@
+#ifndef CHLOROS_SRC_RUN_QUEUE_H_
+#define CHLOROS_SRC_RUN_QUEUE_H_
+
+#include "chloros.h"
+#include <cstddef>
+#include <cstdint>
+#include <x86intrin.h>
+
+namespace chloros {
+
+// Intrusive doubly linked list of threads, linked through `Thread::links`.
+// All operations are constant time, and none of them allocate. A thread is on
+// at most one list at a time.
+class ThreadList {
+public:
+  bool empty() const { return head_ == nullptr; }
+  size_t size() const { return size_; }
+  Thread *front() const { return head_; }
+  Thread *back() const { return tail_; }
+
+  void push_front(Thread *thread) {
+    thread->links.prev = nullptr;
+    thread->links.next = head_;
+    if (head_ != nullptr) {
+      head_->links.prev = thread;
+    } else {
+      tail_ = thread;
+    }
+    head_ = thread;
+    ++size_;
+  }
+
+  void push_back(Thread *thread) {
+    thread->links.prev = tail_;
+    thread->links.next = nullptr;
+    if (tail_ != nullptr) {
+      tail_->links.next = thread;
+    } else {
+      head_ = thread;
+    }
+    tail_ = thread;
+    ++size_;
+  }
+
+  void remove(Thread *thread) {
+    if (thread->links.prev != nullptr) {
+      thread->links.prev->links.next = thread->links.next;
+    } else {
+      head_ = thread->links.next;
+    }
+    if (thread->links.next != nullptr) {
+      thread->links.next->links.prev = thread->links.prev;
+    } else {
+      tail_ = thread->links.prev;
+    }
+    thread->links.prev = nullptr;
+    thread->links.next = nullptr;
+    --size_;
+  }
+
+  // Move all threads of `other` to the back of this list.
+  void splice_back(ThreadList &other) {
+    if (other.empty()) {
+      return;
+    }
+    if (tail_ != nullptr) {
+      tail_->links.next = other.head_;
+      other.head_->links.prev = tail_;
+    } else {
+      head_ = other.head_;
+    }
+    tail_ = other.tail_;
+    size_ += other.size_;
+    other.head_ = nullptr;
+    other.tail_ = nullptr;
+    other.size_ = 0;
+  }
+
+  Thread *pop_front() {
+    Thread *thread = head_;
+    if (thread != nullptr) {
+      remove(thread);
+    }
+    return thread;
+  }
+
+private:
+  Thread *head_{nullptr};
+  Thread *tail_{nullptr};
+  size_t size_{0};
+}; // class ThreadList
+
+// How a ready thread came to be queued.
+enum class Queued {
+  // Spawned without being run right away.
+  kNew,
+  // Woken up after blocking.
+  kWoken,
+  // Still ready after its turn, having yielded or been preempted.
+  kYielded,
+  // To run next: a thread `Spawn` yields to, or one that handed its turn to
+  // another thread and gets it back after.
+  kNext,
+};
+
+// Scheduling policies. A policy sorts ready threads into levels, each a list
+// that is run from the front, with the highest non-empty level going first.
+// It decides which level a thread goes on, whether it goes to the front or
+// the back, and may keep track of how long threads run: a policy with
+// `kTimed` gets the time stamp counter reading of every switch, which the
+// scheduler takes once for everybody that needs it. The policy is a
+// template parameter of `RunQueue`, picked when the library is built, so
+// every decision is inlined into the scheduler.
+
+// Round robin. Only threads that are to run next go to the front.
+struct FifoPolicy {
+  static constexpr int const kLevels{1};
+  static constexpr uint64_t const kBoostTicks{0};
+  static constexpr bool const kTimed{false};
+  static char const *Name() { return "fifo"; }
+  static int Level(Thread const *) { return 0; }
+  static bool Front(Queued how) { return how == Queued::kNext; }
+  static void Switch(Thread *, Thread *, uint64_t) {}
+};
+
+// Most recently spawned or woken up first, which keeps caches warm for
+// fork/join: a thread that spawns children and waits for them runs them, and
+// then itself, while their data is still hot. Peers steal the oldest threads.
+// Threads that yield go to the back, like under FIFO, or two threads yielding
+// to each other would starve everybody else.
+struct LifoPolicy {
+  static constexpr int const kLevels{1};
+  static constexpr uint64_t const kBoostTicks{0};
+  static constexpr bool const kTimed{false};
+  static char const *Name() { return "lifo"; }
+  static int Level(Thread const *) { return 0; }
+  static bool Front(Queued how) { return how != Queued::kYielded; }
+  static void Switch(Thread *, Thread *, uint64_t) {}
+};
+
+// Strict priority, FIFO within a priority. A thread runs only when no thread
+// of a higher priority is ready, so busy high-priority threads starve the
+// rest.
+struct PriorityPolicy {
+  static constexpr int const kLevels{kPriorityLevels};
+  static constexpr uint64_t const kBoostTicks{0};
+  static constexpr bool const kTimed{false};
+  static char const *Name() { return "priority"; }
+  static int Level(Thread const *thread) { return thread->priority; }
+  static bool Front(Queued how) { return how == Queued::kNext; }
+  static void Switch(Thread *, Thread *, uint64_t) {}
+};
+
+// Multi-level feedback queue. Threads start at their priority, and move down
+// a level whenever they run for longer than the time slice of their level
+// before switching, which doubles for each level down. Threads that block or
+// yield often stay where they are, and get ahead of the ones that hog the
+// CPU. Every so often, all queued threads go back to their own priority, so
+// that demoted threads do not starve for good.
+struct MlfqPolicy {
+  static constexpr int const kLevels{kPriorityLevels};
+  // Time slice of the top level, and how often to boost, in time stamp counter
+  // ticks. Roughly 5 microseconds and 10 milliseconds on a 3 GHz machine.
+  static constexpr uint64_t const kSliceTicks{uint64_t{1} << 14};
+  static constexpr uint64_t const kBoostTicks{uint64_t{1} << 25};
+  static constexpr bool const kTimed{true};
+  static char const *Name() { return "mlfq"; }
+  static int Level(Thread const *thread) {
+    return thread->effective_priority;
+  }
+  static bool Front(Queued how) { return how == Queued::kNext; }
+  static void Switch(Thread *prev, Thread *next, uint64_t now) {
+    int level = prev->effective_priority;
+    if (level > 0 &&
+        now - prev->slice_start >= kSliceTicks << (kLevels - 1 - level)) {
+      prev->effective_priority = level - 1;
+    }
+    next->slice_start = now;
+  }
+};
+
+// Ready threads of a kernel thread, ordered by `Policy`. It needs no
+// allocation, and everything but a boost takes constant time.
+template <typename Policy>
+class RunQueue {
+public:
+  static_assert(Policy::kLevels <= 32, "Levels must fit in a bitmap.");
+
+  bool empty() const { return size_ == 0; }
+  size_t size() const { return size_; }
+
+  void Push(Thread *thread, Queued how) {
+    int level = Policy::Level(thread);
+    thread->queue_level = level;
+    if (Policy::Front(how)) {
+      lists_[level].push_front(thread);
+    } else {
+      lists_[level].push_back(thread);
+    }
+    occupied_ |= uint32_t{1} << level;
+    ++size_;
+  }
+
+  void Remove(Thread *thread) {
+    ThreadList &list = lists_[thread->queue_level];
+    list.remove(thread);
+    if (list.empty()) {
+      occupied_ &= ~(uint32_t{1} << thread->queue_level);
+    }
+    --size_;
+  }
+
+  // Thread that should run next, or null if there is none.
+  Thread *Peek() {
+    if (Policy::kBoostTicks != 0 && --peeks_until_boost_check_ == 0) {
+      peeks_until_boost_check_ = kBoostCheckInterval;
+      MaybeBoost();
+    }
+    return empty() ? nullptr : lists_[Top()].front();
+  }
+
+  // Thread a peer should take: the one on the top level that would run last.
+  // Initial threads never move, and there is at most one of them, so this
+  // looks at no more than two threads per level.
+  Thread *StealCandidate() const {
+    for (uint32_t levels = occupied_; levels != 0;) {
+      int level = 31 - __builtin_clz(levels);
+      Thread *thread = lists_[level].back();
+      if (thread->is_initial_kernel_thread) {
+        thread = thread->links.prev;
+      }
+      if (thread != nullptr) {
+        return thread;
+      }
+      levels &= ~(uint32_t{1} << level);
+    }
+    return nullptr;
+  }
+
+private:
+  // Picks between looks at the clock for a boost.
+  static constexpr unsigned const kBoostCheckInterval{64};
+
+  int Top() const { return 31 - __builtin_clz(occupied_); }
+
+  void MaybeBoost() {
+    uint64_t now = __rdtsc();
+    if (now - last_boost_ < Policy::kBoostTicks) {
+      return;
+    }
+    last_boost_ = now;
+    ThreadList all{};
+    for (ThreadList &list : lists_) {
+      all.splice_back(list);
+    }
+    occupied_ = 0;
+    size_ = 0;
+    while (Thread *thread = all.pop_front()) {
+      thread->effective_priority = thread->priority;
+      Push(thread, Queued::kYielded);
+    }
+  }
+
+  ThreadList lists_[Policy::kLevels];
+  // Bit i is set if `lists_[i]` is not empty.
+  uint32_t occupied_{0};
+  size_t size_{0};
+  uint64_t last_boost_{0};
+  unsigned peeks_until_boost_check_{kBoostCheckInterval};
+}; // class RunQueue
+
+// The policy is picked with `-DCHLOROS_POLICY=FifoPolicy` and the like, see
+// the Makefile.
+#ifndef CHLOROS_POLICY
+#define CHLOROS_POLICY FifoPolicy
+#endif
+using SchedulingPolicy = CHLOROS_POLICY;
+using ReadyQueue = RunQueue<SchedulingPolicy>;
+
+} // namespace chloros
+
+#endif // CHLOROS_SRC_RUN_QUEUE_H_
@@ -0,0 +1,132 @@
+#include "runtime.h"
+#include "chloros.h"
+#include "common.h"
+#include "scheduler.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+
+namespace chloros {
+
+namespace {
+
+// Runtime the calling kernel thread is a worker of, if any.
+thread_local Runtime *local_runtime{nullptr};
+
+// Cores we are allowed to run on.
+std::vector<int> AllowedCores() {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  std::vector<int> cores{};
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int core = 0; core < CPU_SETSIZE; ++core) {
+      if (CPU_ISSET(core, &set)) {
+        cores.push_back(core);
+      }
+    }
+  }
+  if (cores.empty()) {
+    cores.push_back(0);
+  }
+  return cores;
+}
+
+void Pin(std::thread &thread, int core) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(core, &set);
+  int error = pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+  if (error != 0) {
+    LOG_WARN("Cannot pin worker to core %d: %s", core, strerror(error));
+  }
+}
+
+} // anonymous namespace
+
+Runtime::Runtime(RuntimeOptions const &options) : options_{options} {
+  std::vector<int> cores = AllowedCores();
+  size_t n = options_.workers != 0 ? options_.workers : cores.size();
+  workers_.resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    workers_[i].thread = std::thread{&Runtime::Work, this, i};
+    if (options_.pin_workers) {
+      Pin(workers_[i].thread, cores[i % cores.size()]);
+    }
+  }
+  // Spawning needs the scheduling state of every worker.
+  std::unique_lock<std::mutex> lock{start_lock_};
+  start_cv_.wait(lock, [&] { return started_ == n; });
+}
+
+Runtime::~Runtime() { Shutdown(); }
+
+JoinHandle Runtime::Spawn(Function fn, void *arg,
+                          SpawnOptions const &options) {
+  KernelThread *target = nullptr;
+  if (local_runtime == this) {
+    target = LocalKernelThread();
+  } else {
+    ASSERT(!stopping_.load(std::memory_order_relaxed),
+           "The runtime is shut down.");
+    // Of two workers, the one with less work queued. Looking at every worker
+    // would cost more than it saves, since stealing evens out the load anyway.
+    size_t i = next_worker_.fetch_add(1, std::memory_order_relaxed);
+    KernelThread *first = workers_[i % workers_.size()].kernel_thread;
+    KernelThread *second = workers_[(i + 1) % workers_.size()].kernel_thread;
+    target = QueuedThreads(*second) < QueuedThreads(*first) ? second : first;
+  }
+  // Wakes up the worker, or another one to steal it, if they are asleep.
+  return SpawnOn(*target, fn, arg, options);
+}
+
+void Runtime::Shutdown() {
+  if (stopped_) {
+    return;
+  }
+  ASSERT(local_runtime != this, "A worker cannot shut down its own runtime.");
+  stopping_.store(true, std::memory_order_release);
+  for (auto &&worker : workers_) {
+    WakeKernelThread(*worker.kernel_thread);
+  }
+  for (auto &&worker : workers_) {
+    worker.thread.join();
+  }
+  stopped_ = true;
+}
+
+void Runtime::Work(size_t index) {
+  Initialize();
+  local_runtime = this;
+  {
+    std::lock_guard<std::mutex> lock{start_lock_};
+    workers_[index].kernel_thread = LocalKernelThread();
+    ++started_;
+  }
+  start_cv_.notify_all();
+  if (options_.preemption) {
+    SetPreemption(true);
+  }
+
+  for (;;) {
+    // Read first, so that a wakeup from `Shutdown` after we look is not lost.
+    uint32_t seen = Wakeups();
+    // Everything spawned before the runtime was stopped is on some queue by
+    // now, so one more round of `Wait` runs it.
+    bool stopping = stopping_.load(std::memory_order_acquire);
+    Wait();
+    if (stopping) {
+      break;
+    }
+    // Until a thread is spawned here, or there is one to steal.
+    IdleSleep(seen);
+  }
+
+  if (options_.preemption) {
+    SetPreemption(false);
+  }
+  local_runtime = nullptr;
+}
+
+} // namespace chloros
@@ -0,0 +1,50 @@
+#ifndef CHLOROS_SRC_SCHEDULER_H_
+#define CHLOROS_SRC_SCHEDULER_H_
+
+#include "chloros.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace chloros {
+
+// Scheduling state of a kernel thread, opaque outside of the scheduler.
+struct KernelThread;
+
+struct Timer;
+
+// Scheduling state of the calling kernel thread, or null if it has not called
+// `Initialize`.
+KernelThread *LocalKernelThread();
+
+// Create a thread running `fn(arg)` and put it at the back of the run queue of
+// `kt`, which may belong to another kernel thread. Unlike `SpawnDetached`, the
+// caller does not need to be a green thread itself.
+JoinHandle SpawnOn(KernelThread &kt, Function fn, void *arg,
+                   SpawnOptions const &options);
+
+// Idle parking. Whatever may give a kernel thread something to do, like
+// queueing a thread there or waking up one that blocked there, moves on a
+// count of its wakeups, and wakes it up if it is asleep. To sleep until
+// then, read `Wakeups` before looking for something to do, and pass it to
+// `IdleSleep`, which returns right away if the count has moved on since.
+// `IdleSleep` also returns when a peer has threads to steal, or a timer here
+// is due, and waits for I/O instead when there is any.
+uint32_t Wakeups();
+void IdleSleep(uint32_t seen);
+
+// Move on the count of wakeups of `kt`, and wake it up if it is asleep.
+// Returns whether it was. `SpawnOn` and `Unpark` already do this.
+bool WakeKernelThread(KernelThread &kt);
+
+// Number of threads queued on `kt` that any kernel thread could run. A rough
+// measure of load, read without locking.
+size_t QueuedThreads(KernelThread const &kt);
+
+// Start `timer` on the timing wheel of the calling kernel thread, to fire at
+// `deadline` once this kernel thread gets to it. Use it to time out a thread
+// that is about to park here. Stop it with `timer->wheel->Stop(timer)`.
+void StartTimer(Timer *timer, Deadline deadline);
+
+} // namespace chloros
+
+#endif // CHLOROS_SRC_SCHEDULER_H_
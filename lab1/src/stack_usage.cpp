@@ -0,0 +1,118 @@
+#include "stack_usage.h"
+#include "common.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace chloros {
+
+namespace {
+
+size_t const kPageSize{static_cast<size_t>(sysconf(_SC_PAGESIZE))};
+
+// Number of pages we ask `mincore` about at once.
+constexpr size_t const kResidencyBatch{256};
+
+std::atomic<bool> painting{false};
+std::atomic<bool> adaptive{false};
+
+// Stack use per entry function.
+std::mutex usage_lock{};
+std::unordered_map<Function, StackUsage> usage{};
+
+// Find the lowest address written to on a painted stack. Painting leaves every
+// page untouched, so the deepest resident page is as far as the thread got,
+// and only that one page has to be scanned for the first word that is not
+// zero.
+uint8_t *HighWaterMark(uint8_t *base, uint8_t *top) {
+  unsigned char resident[kResidencyBatch];
+  for (uint8_t *batch = base; batch < top;
+       batch += kResidencyBatch * kPageSize) {
+    size_t pages = std::min(kResidencyBatch,
+                            static_cast<size_t>(top - batch) / kPageSize);
+    ASSERT(mincore(batch, pages * kPageSize, resident) == 0,
+           "Cannot query stack: %s", strerror(errno));
+    for (size_t i = 0; i < pages; ++i) {
+      if (resident[i] & 1) {
+        auto word = reinterpret_cast<uint64_t const *>(batch + i * kPageSize);
+        auto end = word + kPageSize / sizeof(uint64_t);
+        while (word != end && *word == 0) {
+          ++word;
+        }
+        return reinterpret_cast<uint8_t *>(const_cast<uint64_t *>(word));
+      }
+    }
+  }
+  return top;
+}
+
+} // anonymous namespace
+
+bool StackPaintingEnabled() {
+  return painting.load(std::memory_order_relaxed);
+}
+
+size_t StackSizeFor(Function fn) {
+  if (!adaptive.load(std::memory_order_relaxed)) {
+    return kDefaultStackSize;
+  }
+  std::lock_guard<std::mutex> lock{usage_lock};
+  auto it = usage.find(fn);
+  if (it == usage.end()) {
+    return kDefaultStackSize;
+  }
+  return it->second.max_bytes + kStackSafetyMargin;
+}
+
+void PaintStack(Thread *thread) {
+  // Hand every page below the top one back to the kernel, so they are fresh
+  // zero pages that are not resident until touched. The top page is about to
+  // be used anyway, so clear that one by hand instead.
+  uint8_t *base = thread->stack - thread->stack_size;
+  uint8_t *top_page = thread->stack - kPageSize;
+  ASSERT(madvise(base, top_page - base, MADV_DONTNEED) == 0,
+         "Cannot paint stack: %s", strerror(errno));
+  memset(top_page, 0, kPageSize);
+  thread->stack_painted = true;
+}
+
+void RecordStackUsage(Thread const *thread) {
+  uint8_t *base = thread->stack - thread->stack_size;
+  size_t used = thread->stack - HighWaterMark(base, thread->stack);
+  std::lock_guard<std::mutex> lock{usage_lock};
+  StackUsage &entry = usage[thread->entry];
+  ++entry.threads;
+  entry.max_bytes = std::max(entry.max_bytes, used);
+  entry.total_bytes += used;
+}
+
+void SetStackPainting(bool enabled) {
+  painting.store(enabled, std::memory_order_relaxed);
+}
+
+void SetAdaptiveStackSize(bool enabled) {
+  if (enabled) {
+    painting.store(true, std::memory_order_relaxed);
+  }
+  adaptive.store(enabled, std::memory_order_relaxed);
+}
+
+StackUsage GetStackUsage(Function fn) {
+  NoPreemptGuard guard{};
+  std::lock_guard<std::mutex> lock{usage_lock};
+  auto it = usage.find(fn);
+  return it == usage.end() ? StackUsage{} : it->second;
+}
+
+std::vector<std::pair<Function, StackUsage>> GetStackUsageReport() {
+  NoPreemptGuard guard{};
+  std::lock_guard<std::mutex> lock{usage_lock};
+  return {usage.begin(), usage.end()};
+}
+
+} // namespace chloros
@@ -0,0 +1,30 @@
+#ifndef CHLOROS_SRC_STACK_USAGE_H_
+#define CHLOROS_SRC_STACK_USAGE_H_
+
+#include "chloros.h"
+#include <cstddef>
+
+namespace chloros {
+
+// Added to the deepest stack use seen for a function when sizing stacks
+// adaptively. Covers what a single run may use beyond what we have seen,
+// including a signal frame with the full vector state.
+constexpr size_t const kStackSafetyMargin{1 << 14};
+
+// Whether new threads should get painted stacks.
+bool StackPaintingEnabled();
+
+// Pick a stack size for a thread running `fn` that did not ask for one.
+size_t StackSizeFor(Function fn);
+
+// Prepare the stack of a thread that has not run yet, so that we can find out
+// later how deep it went. Must be called before anything is put on it.
+void PaintStack(Thread *thread);
+
+// Measure how deep the painted stack of `thread` went and record it for its
+// entry function.
+void RecordStackUsage(Thread const *thread);
+
+} // namespace chloros
+
+#endif // CHLOROS_SRC_STACK_USAGE_H_
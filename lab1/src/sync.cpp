@@ -0,0 +1,172 @@
+#include "sync.h"
+#include "chloros.h"
+#include "common.h"
+#include <mutex>
+#include <utility>
+
+namespace chloros {
+
+namespace {
+
+// Park the current thread on `waiters`, which is guarded by `lock`. The caller
+// must hold `lock`; it is released by the time this returns.
+void ParkOn(SpinLock &lock, WaitList &waiters) {
+  Waiter waiter{};
+  waiter.thread = CurrentThread();
+  waiters.push_back(&waiter);
+  Park(lock);
+}
+
+// Same as `ParkOn`, but give up at `deadline`. Returns false if it passed.
+bool ParkOnUntil(SpinLock &lock, WaitList &waiters, Deadline deadline) {
+  Waiter waiter{};
+  waiter.thread = CurrentThread();
+  waiters.push_back(&waiter);
+  return ParkUntil(lock, waiters, &waiter, deadline);
+}
+
+// Wake up all threads on `waiters`. They were taken off their list under its
+// lock, so nobody else can wake them up too.
+void UnparkAll(WaitList &waiters) {
+  while (Waiter *waiter = waiters.pop_front()) {
+    // The waiter lives on the stack of its thread, which can go away as soon
+    // as the thread is woken up.
+    Unpark(waiter->thread);
+  }
+}
+
+} // anonymous namespace
+
+void Mutex::lock() {
+  lock_.lock();
+  if (!locked_) {
+    locked_ = true;
+    lock_.unlock();
+    return;
+  }
+  // Whoever unlocks passes the mutex on to us without unlocking it.
+  ParkOn(lock_, waiters_);
+}
+
+bool Mutex::try_lock() {
+  std::lock_guard<SpinLock> lock{lock_};
+  if (locked_) {
+    return false;
+  }
+  locked_ = true;
+  return true;
+}
+
+bool Mutex::try_lock_until(Deadline deadline) {
+  lock_.lock();
+  if (!locked_) {
+    locked_ = true;
+    lock_.unlock();
+    return true;
+  }
+  return ParkOnUntil(lock_, waiters_, deadline);
+}
+
+void Mutex::unlock() {
+  lock_.lock();
+  ASSERT(locked_, "Mutex is not locked.");
+  Waiter *waiter = waiters_.pop_front();
+  if (waiter == nullptr) {
+    locked_ = false;
+  }
+  lock_.unlock();
+  if (waiter != nullptr) {
+    Unpark(waiter->thread);
+  }
+}
+
+void CondVar::Wait(Mutex &mutex) {
+  lock_.lock();
+  // We are on the list before letting go of the mutex, so a signal sent by
+  // whoever takes it next cannot get lost.
+  mutex.unlock();
+  ParkOn(lock_, waiters_);
+  mutex.lock();
+}
+
+bool CondVar::WaitUntil(Mutex &mutex, Deadline deadline) {
+  lock_.lock();
+  mutex.unlock();
+  bool signalled = ParkOnUntil(lock_, waiters_, deadline);
+  mutex.lock();
+  return signalled;
+}
+
+void CondVar::Signal() {
+  lock_.lock();
+  Waiter *waiter = waiters_.pop_front();
+  lock_.unlock();
+  if (waiter != nullptr) {
+    Unpark(waiter->thread);
+  }
+}
+
+void CondVar::Broadcast() {
+  WaitList waiters{};
+  lock_.lock();
+  while (Waiter *waiter = waiters_.pop_front()) {
+    waiters.push_back(waiter);
+  }
+  lock_.unlock();
+  UnparkAll(waiters);
+}
+
+void Semaphore::Acquire() {
+  lock_.lock();
+  if (count_ > 0) {
+    --count_;
+    lock_.unlock();
+    return;
+  }
+  // The unit is handed to us by `Release` without going through `count_`.
+  ParkOn(lock_, waiters_);
+}
+
+bool Semaphore::TryAcquire() {
+  std::lock_guard<SpinLock> lock{lock_};
+  if (count_ == 0) {
+    return false;
+  }
+  --count_;
+  return true;
+}
+
+bool Semaphore::TryAcquireUntil(Deadline deadline) {
+  lock_.lock();
+  if (count_ > 0) {
+    --count_;
+    lock_.unlock();
+    return true;
+  }
+  return ParkOnUntil(lock_, waiters_, deadline);
+}
+
+void Semaphore::Release(size_t n) {
+  WaitList waiters{};
+  lock_.lock();
+  for (; n > 0 && !waiters_.empty(); --n) {
+    waiters.push_back(waiters_.pop_front());
+  }
+  count_ += n;
+  lock_.unlock();
+  UnparkAll(waiters);
+}
+
+void Semaphore::ReleaseAndSwitch() {
+  lock_.lock();
+  Waiter *waiter = waiters_.pop_front();
+  if (waiter == nullptr) {
+    ++count_;
+  }
+  lock_.unlock();
+  if (waiter != nullptr) {
+    UnparkAndSwitch(waiter->thread);
+  }
+}
+
+} // namespace chloros
@@ -0,0 +1,176 @@
+#include "timer.h"
+#include "common.h"
+#include <algorithm>
+#include <mutex>
+
+namespace chloros {
+
+namespace {
+
+constexpr uint64_t const kSlotMask{TimerWheel::kSlots - 1};
+
+int Shift(int level) { return level * TimerWheel::kSlotBits; }
+
+uint64_t RotateRight(uint64_t bits, int n) {
+  return n == 0 ? bits : (bits >> n) | (bits << (64 - n));
+}
+
+} // anonymous namespace
+
+uint64_t NowTicks() { return ToTicks(Clock::now()); }
+
+uint64_t ToTicks(Deadline deadline) {
+  auto nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         deadline.time_since_epoch())
+                         .count();
+  return static_cast<uint64_t>(std::max<int64_t>(nanoseconds, 0) + 999) / 1000;
+}
+
+void TimerWheel::Start(Timer *timer, uint64_t expiry) {
+  std::lock_guard<RawSpinLock> lock{lock_};
+  // Nothing is pending, so there is nothing to catch up on. Moving up to the
+  // present keeps a wheel that was quiet for a long time from placing the
+  // timer as if it were far off.
+  if (size_.load(std::memory_order_relaxed) == 0) {
+    now_ = std::max(now_, NowTicks());
+  }
+  timer->expiry = std::max(expiry, now_ + 1);
+  timer->wheel = this;
+  Insert(timer);
+  size_.store(size_.load(std::memory_order_relaxed) + 1,
+              std::memory_order_relaxed);
+}
+
+bool TimerWheel::Stop(Timer *timer) {
+  std::lock_guard<RawSpinLock> lock{lock_};
+  if (timer->slot < 0) {
+    return false;
+  }
+  Unlink(timer);
+  size_.store(size_.load(std::memory_order_relaxed) - 1,
+              std::memory_order_relaxed);
+  return true;
+}
+
+int TimerWheel::Expire(uint64_t now) {
+  std::lock_guard<RawSpinLock> lock{lock_};
+  int fired = 0;
+  // Skip straight from one occupied slot to the next.
+  for (uint64_t tick = NextTickLocked(); tick <= now; tick = NextTickLocked()) {
+    now_ = tick;
+    fired += Advance();
+  }
+  now_ = std::max(now_, now);
+  return fired;
+}
+
+uint64_t TimerWheel::NextTick() {
+  std::lock_guard<RawSpinLock> lock{lock_};
+  return NextTickLocked();
+}
+
+// Put `timer` in the lowest level whose slots reach its expiry. Must be called
+// with `lock_` held.
+void TimerWheel::Insert(Timer *timer) {
+  int level = 0;
+  uint64_t index = 0;
+  for (; level < kLevels; ++level) {
+    uint64_t position = now_ >> Shift(level);
+    uint64_t target = timer->expiry >> Shift(level);
+    if (target - position < kSlots) {
+      index = target & kSlotMask;
+      break;
+    }
+  }
+  if (level == kLevels) {
+    // Too far off for the wheel. It comes back around in the last slot, and
+    // is placed again from there.
+    level = kLevels - 1;
+    index = ((now_ >> Shift(level)) + kSlots - 1) & kSlotMask;
+  }
+  Timer *&head = slots_[level][index];
+  timer->slot = level * kSlots + static_cast<int>(index);
+  timer->prev = nullptr;
+  timer->next = head;
+  if (head != nullptr) {
+    head->prev = timer;
+  }
+  head = timer;
+  occupied_[level] |= uint64_t{1} << index;
+}
+
+// Must be called with `lock_` held.
+void TimerWheel::Unlink(Timer *timer) {
+  int level = timer->slot / kSlots;
+  int index = timer->slot % kSlots;
+  if (timer->prev != nullptr) {
+    timer->prev->next = timer->next;
+  } else {
+    slots_[level][index] = timer->next;
+    if (timer->next == nullptr) {
+      occupied_[level] &= ~(uint64_t{1} << index);
+    }
+  }
+  if (timer->next != nullptr) {
+    timer->next->prev = timer->prev;
+  }
+  timer->slot = -1;
+  timer->prev = nullptr;
+  timer->next = nullptr;
+}
+
+// The slot at a level's current position has been dealt with, so each level
+// contributes the start of its first occupied slot after that one.
+uint64_t TimerWheel::NextTickLocked() const {
+  uint64_t next = kNever;
+  for (int level = 0; level < kLevels; ++level) {
+    if (occupied_[level] == 0) {
+      continue;
+    }
+    uint64_t position = now_ >> Shift(level);
+    int from = static_cast<int>((position + 1) & kSlotMask);
+    uint64_t distance = __builtin_ctzll(RotateRight(occupied_[level], from)) + 1;
+    next = std::min(next, (position + distance) << Shift(level));
+  }
+  return next;
+}
+
+// Process tick `now_`: move the timers of every slot of a higher level that
+// starts here down, highest first, then fire the timers of the slot of level 0.
+// Returns how many fired. Must be called with `lock_` held.
+int TimerWheel::Advance() {
+  for (int level = kLevels - 1; level > 0; --level) {
+    if ((now_ & ((uint64_t{1} << Shift(level)) - 1)) != 0) {
+      continue;
+    }
+    uint64_t index = (now_ >> Shift(level)) & kSlotMask;
+    Timer *timer = slots_[level][index];
+    slots_[level][index] = nullptr;
+    occupied_[level] &= ~(uint64_t{1} << index);
+    while (timer != nullptr) {
+      Timer *next = timer->next;
+      Insert(timer);
+      timer = next;
+    }
+  }
+  uint64_t index = now_ & kSlotMask;
+  Timer *timer = slots_[0][index];
+  slots_[0][index] = nullptr;
+  occupied_[0] &= ~(uint64_t{1} << index);
+  int fired = 0;
+  while (timer != nullptr) {
+    Timer *next = timer->next;
+    timer->slot = -1;
+    timer->prev = nullptr;
+    timer->next = nullptr;
+    size_.store(size_.load(std::memory_order_relaxed) - 1,
+                std::memory_order_relaxed);
+    ++fired;
+    // The timer may be gone once this returns.
+    timer->fire(timer);
+    timer = next;
+  }
+  return fired;
+}
+
+} // namespace chloros
@@ -0,0 +1,95 @@
+#ifndef CHLOROS_SRC_TIMER_H_
+#define CHLOROS_SRC_TIMER_H_
+
+#include "chloros.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace chloros {
+
+// Timers count in ticks of one microsecond of `Clock`.
+uint64_t NowTicks();
+
+// First tick at or after `deadline`.
+uint64_t ToTicks(Deadline deadline);
+
+class TimerWheel;
+
+// A pending timeout. It lives wherever its owner likes, usually on the stack
+// of a parked thread, and is linked into the wheel until it fires or is
+// stopped.
+struct Timer {
+  // Called when the timer expires, on the kernel thread that started it, with
+  // the wheel locked. The wheel is done with the timer by then, so `fire` may
+  // wake up the thread it belongs to, after which neither may touch it.
+  void (*fire)(Timer *timer) = nullptr;
+  // For `fire` to use.
+  void *data = nullptr;
+  // Tick it expires at.
+  uint64_t expiry = 0;
+  // Wheel it is in, and where, while it is pending.
+  TimerWheel *wheel = nullptr;
+  int slot = -1;
+  Timer *prev = nullptr;
+  Timer *next = nullptr;
+};
+
+// Hierarchical timing wheel. Level 0 has a slot for each of the next 64
+// ticks, level 1 one for each of the next 64 runs of 64 ticks, and so on, for
+// about 2^36 ticks, or 19 hours, with timers further out parked in the last
+// slot of the top level. Starting and stopping a timer is a few pointer
+// writes, and so is firing it, plus moving it down a level at most once per
+// level as its expiry draws near. Occupied slots are tracked in a bitmap per
+// level, so finding the next one to look at never scans empty slots.
+//
+// A wheel belongs to a kernel thread, which is the only one to start and fire
+// its timers, but a thread woken up by something else may stop its timer from
+// another kernel thread. Timers fire with the wheel locked, so `Stop`
+// returning means the timer is not firing either.
+class TimerWheel {
+public:
+  static constexpr int const kLevels{6};
+  static constexpr int const kSlotBits{6};
+  static constexpr int const kSlots{1 << kSlotBits};
+
+  TimerWheel() = default;
+  TimerWheel(TimerWheel const &) = delete;
+  TimerWheel &operator=(TimerWheel const &) = delete;
+
+  // Start `timer` to fire at tick `expiry`. A tick that has passed already
+  // means the next one.
+  void Start(Timer *timer, uint64_t expiry);
+
+  // Stop `timer` if it is still pending. Returns false if it fired already.
+  bool Stop(Timer *timer);
+
+  // Fire every timer that expires at tick `now` or before. Returns how many.
+  int Expire(uint64_t now);
+
+  // Earliest tick at which `Expire` may have something to do, which may be
+  // before the earliest expiry when a timer still has to move down a level
+  // first. `kNever` if there are no timers.
+  uint64_t NextTick();
+
+  static constexpr uint64_t const kNever{~uint64_t{0}};
+
+  // Number of pending timers, read without locking.
+  size_t size() const { return size_.load(std::memory_order_relaxed); }
+
+private:
+  void Insert(Timer *timer);
+  void Unlink(Timer *timer);
+  uint64_t NextTickLocked() const;
+  int Advance();
+
+  RawSpinLock lock_{};
+  // Every tick up to this one has been processed.
+  uint64_t now_{0};
+  uint64_t occupied_[kLevels] = {};
+  Timer *slots_[kLevels][kSlots] = {};
+  std::atomic<size_t> size_{0};
+}; // class TimerWheel
+
+} // namespace chloros
+
+#endif // CHLOROS_SRC_TIMER_H_
@@ -0,0 +1,250 @@
+#include "trace.h"
+#include "common.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <thread>
+#include <x86intrin.h>
+
+namespace chloros {
+
+static_assert((kTraceEvents & (kTraceEvents - 1)) == 0,
+              "The trace buffer size must be a power of two.");
+
+std::atomic<bool> tracing{false};
+
+namespace {
+
+// Time stamp counter reading when the tracer was last turned on. Anything
+// older is left out.
+std::atomic<uint64_t> trace_start{0};
+
+// List of all trace buffers ever created.
+std::atomic<TraceBuffer *> trace_buffers{nullptr};
+
+// How long we watch the time stamp counter to find out how fast it goes.
+constexpr std::chrono::milliseconds const kCalibrationTime{10};
+
+double TicksPerMicrosecond() {
+  static double const ticks = [] {
+    auto begin = std::chrono::steady_clock::now();
+    uint64_t begin_tsc = __rdtsc();
+    std::this_thread::sleep_for(kCalibrationTime);
+    std::chrono::duration<double, std::micro> elapsed =
+        std::chrono::steady_clock::now() - begin;
+    return (__rdtsc() - begin_tsc) / elapsed.count();
+  }();
+  return ticks;
+}
+
+char const *EventName(TraceEventType type) {
+  switch (type) {
+  case TraceEventType::kSwitch:
+    return "switch";
+  case TraceEventType::kIdle:
+    return "idle";
+  case TraceEventType::kSpawn:
+    return "spawn";
+  case TraceEventType::kExit:
+    return "exit";
+  case TraceEventType::kPark:
+    return "park";
+  case TraceEventType::kWake:
+    return "wake";
+  case TraceEventType::kSteal:
+    return "steal";
+  }
+  return "unknown";
+}
+
+// Name of the argument of an event of `type`, if it has one.
+char const *ArgName(TraceEventType type) {
+  switch (type) {
+  case TraceEventType::kSpawn:
+    return "parent";
+  case TraceEventType::kWake:
+    return "by";
+  case TraceEventType::kSteal:
+    return "from";
+  default:
+    return nullptr;
+  }
+}
+
+// Writes trace_event JSON, keeping track of what each kernel thread runs.
+class ChromeTraceWriter {
+public:
+  ChromeTraceWriter(FILE *file, uint64_t origin)
+      : file_{file}, origin_{origin}, ticks_per_us_{TicksPerMicrosecond()} {}
+
+  void Begin() {
+    fprintf(file_, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+  }
+
+  void Add(TraceEvent const &event) {
+    Track &track = tracks_[event.kernel_thread];
+    switch (event.type) {
+    case TraceEventType::kSwitch:
+      EndSlice(event.kernel_thread, track, event.tsc);
+      track.running = true;
+      track.thread = event.thread;
+      track.since = event.tsc;
+      break;
+    case TraceEventType::kIdle:
+      EndSlice(event.kernel_thread, track, event.tsc);
+      break;
+    default:
+      Separate();
+      fprintf(file_,
+              "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"pid\":0,"
+              "\"tid\":%" PRIu32 ",\"ts\":%.3f,\"args\":{\"thread\":%" PRIu64,
+              EventName(event.type), event.kernel_thread, Time(event.tsc),
+              event.thread);
+      if (char const *arg = ArgName(event.type)) {
+        fprintf(file_, ",\"%s\":%" PRIu64, arg, event.arg);
+      }
+      fprintf(file_, "}}");
+    }
+  }
+
+  // Cut off the slices still running at `end`, and name the tracks.
+  void End(uint64_t end) {
+    for (auto &&entry : tracks_) {
+      EndSlice(entry.first, entry.second, end);
+      Separate();
+      fprintf(file_,
+              "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+              "\"tid\":%" PRIu32 ",\"args\":{\"name\":\"kernel thread "
+              "%" PRIu32 "\"}}",
+              entry.first, entry.first);
+    }
+    fprintf(file_, "\n]}\n");
+  }
+
+private:
+  struct Track {
+    bool running = false;
+    uint64_t thread = 0;
+    uint64_t since = 0;
+  };
+
+  void Separate() {
+    fprintf(file_, "%s\n", first_ ? "" : ",");
+    first_ = false;
+  }
+
+  double Time(uint64_t tsc) const { return (tsc - origin_) / ticks_per_us_; }
+
+  void EndSlice(uint32_t kernel_thread, Track &track, uint64_t end) {
+    if (!track.running) {
+      return;
+    }
+    track.running = false;
+    Separate();
+    fprintf(file_,
+            "{\"name\":\"thread %" PRIu64 "\",\"ph\":\"X\",\"pid\":0,"
+            "\"tid\":%" PRIu32 ",\"ts\":%.3f,\"dur\":%.3f,"
+            "\"args\":{\"thread\":%" PRIu64 "}}",
+            track.thread, kernel_thread, Time(track.since),
+            (end - track.since) / ticks_per_us_, track.thread);
+  }
+
+  FILE *file_;
+  uint64_t const origin_;
+  double const ticks_per_us_;
+  bool first_ = true;
+  std::map<uint32_t, Track> tracks_{};
+}; // class ChromeTraceWriter
+
+} // anonymous namespace
+
+TraceBuffer::TraceBuffer(uint32_t kernel_thread)
+    : kernel_thread_{kernel_thread}, slots_{new Slot[kTraceEvents]()} {}
+
+void TraceBuffer::Read(uint64_t since, std::vector<TraceEvent> &events) const {
+  uint64_t end = written_.load(std::memory_order_acquire);
+  uint64_t begin = end > kTraceEvents ? end - kTraceEvents : 0;
+  size_t first = events.size();
+  for (uint64_t i = begin; i < end; ++i) {
+    Slot const &slot = slots_[i & (kTraceEvents - 1)];
+    TraceEvent event{};
+    event.tsc = slot.tsc.load(std::memory_order_relaxed);
+    event.type = static_cast<TraceEventType>(
+        slot.type.load(std::memory_order_relaxed));
+    event.kernel_thread = kernel_thread_;
+    event.thread = slot.thread.load(std::memory_order_relaxed);
+    event.arg = slot.arg.load(std::memory_order_relaxed);
+    events.push_back(event);
+  }
+  // Pairs with the fence in `Record`. The writer may have been overwriting
+  // the event `kTraceEvents` before the one it got to, or anything older.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  uint64_t now = written_.load(std::memory_order_relaxed);
+  uint64_t valid = now + 1 > kTraceEvents ? now + 1 - kTraceEvents : 0;
+  size_t torn = static_cast<size_t>(std::max(valid, begin) - begin);
+  auto kept = events.begin() + first + std::min(torn, events.size() - first);
+  // Events are in order, so those too old are all at the front.
+  kept = std::find_if(kept, events.end(), [since](TraceEvent const &event) {
+    return event.tsc >= since;
+  });
+  events.erase(events.begin() + first, kept);
+}
+
+TraceBuffer *NewTraceBuffer(uint32_t kernel_thread) {
+  auto buffer = new TraceBuffer{kernel_thread};
+  buffer->next = trace_buffers.load(std::memory_order_relaxed);
+  while (!trace_buffers.compare_exchange_weak(buffer->next, buffer,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed)) {
+  }
+  return buffer;
+}
+
+void SetTracing(bool enabled) {
+  if (enabled) {
+    trace_start.store(__rdtsc(), std::memory_order_relaxed);
+  }
+  tracing.store(enabled, std::memory_order_relaxed);
+}
+
+std::vector<TraceEvent> GetTrace() {
+  uint64_t since = trace_start.load(std::memory_order_relaxed);
+  std::vector<TraceEvent> events{};
+  for (TraceBuffer *buffer = trace_buffers.load(std::memory_order_acquire);
+       buffer != nullptr; buffer = buffer->next) {
+    buffer->Read(since, events);
+  }
+  std::stable_sort(events.begin(), events.end(),
+                   [](TraceEvent const &a, TraceEvent const &b) {
+                     return a.tsc < b.tsc;
+                   });
+  return events;
+}
+
+bool WriteChromeTrace(char const *path) {
+  std::vector<TraceEvent> events = GetTrace();
+  FILE *file = fopen(path, "w");
+  if (file == nullptr) {
+    LOG_WARN("Cannot open %s: %s", path, strerror(errno));
+    return false;
+  }
+  uint64_t origin = events.empty() ? 0 : events.front().tsc;
+  ChromeTraceWriter writer{file, origin};
+  writer.Begin();
+  for (TraceEvent const &event : events) {
+    writer.Add(event);
+  }
+  writer.End(events.empty() ? 0 : events.back().tsc);
+  bool failed = ferror(file) != 0;
+  if (fclose(file) != 0 || failed) {
+    LOG_WARN("Cannot write %s: %s", path, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+} // namespace chloros
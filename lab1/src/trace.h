@@ -0,0 +1,72 @@
+#ifndef CHLOROS_SRC_TRACE_H_
+#define CHLOROS_SRC_TRACE_H_
+
+#include "chloros.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace chloros {
+
+// Whether the tracer is on, see `SetTracing`.
+extern std::atomic<bool> tracing;
+
+// The latest `kTraceEvents` scheduling events of a kernel thread. Only the
+// kernel thread writes them, and anybody may read them, without locks: a
+// reader copies whatever it finds, then drops what the writer may have
+// overwritten in the meantime, which it can tell from how far the writer got
+// by then. Every field is a relaxed atomic, so that a torn read is merely
+// wrong rather than undefined, which on AMD64 makes them plain moves.
+class TraceBuffer {
+public:
+  explicit TraceBuffer(uint32_t kernel_thread);
+  TraceBuffer(TraceBuffer const &) = delete;
+  TraceBuffer &operator=(TraceBuffer const &) = delete;
+
+  // Record an event that happened at time stamp counter reading `tsc`. Must
+  // be called by the kernel thread that owns the buffer.
+  void Record(uint64_t tsc, TraceEventType type, uint64_t thread,
+              uint64_t arg) {
+    uint64_t i = written_.load(std::memory_order_relaxed);
+    Slot &slot = slots_[i & (kTraceEvents - 1)];
+    // Keeps the stores below after the one that published the event before,
+    // so that a reader who sees any of them also sees that the event they
+    // overwrite is gone.
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.tsc.store(tsc, std::memory_order_relaxed);
+    slot.type.store(static_cast<uint64_t>(type), std::memory_order_relaxed);
+    slot.thread.store(thread, std::memory_order_relaxed);
+    slot.arg.store(arg, std::memory_order_relaxed);
+    written_.store(i + 1, std::memory_order_release);
+  }
+
+  // Append the events recorded at time stamp counter reading `since` or
+  // later to `events`, oldest first.
+  void Read(uint64_t since, std::vector<TraceEvent> &events) const;
+
+  // Next buffer in the list of all of them.
+  TraceBuffer *next = nullptr;
+
+private:
+  struct Slot {
+    std::atomic<uint64_t> tsc;
+    std::atomic<uint64_t> type;
+    std::atomic<uint64_t> thread;
+    std::atomic<uint64_t> arg;
+  };
+
+  uint32_t const kernel_thread_;
+  // Number of events recorded so far, including overwritten ones.
+  std::atomic<uint64_t> written_{0};
+  std::unique_ptr<Slot[]> slots_;
+}; // class TraceBuffer
+
+// Create a buffer for the kernel thread numbered `kernel_thread`. Buffers are
+// never freed, so that readers may look at any of them at any time; a kernel
+// thread hands its own on to the next one to take its number.
+TraceBuffer *NewTraceBuffer(uint32_t kernel_thread);
+
+} // namespace chloros
+
+#endif // CHLOROS_SRC_TRACE_H_
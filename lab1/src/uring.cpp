@@ -0,0 +1,132 @@
+#include "uring.h"
+#include "common.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace chloros {
+
+namespace {
+
+int SetUp(unsigned entries, io_uring_params *params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int Enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                  min_complete, flags, nullptr, 0));
+}
+
+void *Map(int fd, size_t size, off_t offset) {
+  void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, offset);
+  return memory == MAP_FAILED ? nullptr : memory;
+}
+
+template <typename T> T *At(void *ring, uint32_t offset) {
+  return reinterpret_cast<T *>(static_cast<uint8_t *>(ring) + offset);
+}
+
+} // anonymous namespace
+
+Ring::~Ring() {
+  if (sqes_ != nullptr) {
+    munmap(sqes_, sqes_size_);
+  }
+  if (cq_ring_ != nullptr && cq_ring_ != sq_ring_) {
+    munmap(cq_ring_, cq_ring_size_);
+  }
+  if (sq_ring_ != nullptr) {
+    munmap(sq_ring_, sq_ring_size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+bool Ring::Init(unsigned entries) {
+  io_uring_params params{};
+  int fd = SetUp(entries, &params);
+  if (fd < 0) {
+    LOG_DEBUG("No io_uring: %s", strerror(errno));
+    return false;
+  }
+  fd_ = fd;
+
+  sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_ring_size_ =
+      params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  // Newer kernels map both rings in one go.
+  bool single_map = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_map) {
+    sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+  }
+  sq_ring_ = Map(fd_, sq_ring_size_, IORING_OFF_SQ_RING);
+  cq_ring_ = single_map ? sq_ring_ : Map(fd_, cq_ring_size_, IORING_OFF_CQ_RING);
+  sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+  sqes_ = static_cast<io_uring_sqe *>(Map(fd_, sqes_size_, IORING_OFF_SQES));
+  if (sq_ring_ == nullptr || cq_ring_ == nullptr || sqes_ == nullptr) {
+    LOG_WARN("Cannot map io_uring: %s", strerror(errno));
+    return false;
+  }
+
+  sq_head_ = At<unsigned>(sq_ring_, params.sq_off.head);
+  sq_tail_ = At<unsigned>(sq_ring_, params.sq_off.tail);
+  sq_mask_ = *At<unsigned>(sq_ring_, params.sq_off.ring_mask);
+  sq_entries_ = params.sq_entries;
+  sq_array_ = At<unsigned>(sq_ring_, params.sq_off.array);
+  cq_head_ = At<unsigned>(cq_ring_, params.cq_off.head);
+  cq_tail_ = At<unsigned>(cq_ring_, params.cq_off.tail);
+  cq_mask_ = *At<unsigned>(cq_ring_, params.cq_off.ring_mask);
+  cq_entries_ = params.cq_entries;
+  cqes_ = At<io_uring_cqe>(cq_ring_, params.cq_off.cqes);
+  return true;
+}
+
+bool Ring::PrepareReadWrite(bool write, int fd, void *buffer, unsigned size,
+                            uint64_t offset, uint64_t user_data) {
+  unsigned tail = *sq_tail_;
+  // The kernel moves the head as it consumes submissions.
+  if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+    return false;
+  }
+  unsigned index = tail & sq_mask_;
+  io_uring_sqe &sqe = sqes_[index];
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+  sqe.fd = fd;
+  sqe.addr = reinterpret_cast<uint64_t>(buffer);
+  sqe.len = size;
+  sqe.off = offset;
+  sqe.user_data = user_data;
+  sq_array_[index] = index;
+  __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+  ++queued_;
+  return true;
+}
+
+bool Ring::Submit() {
+  if (queued_ == 0) {
+    return false;
+  }
+  int submitted;
+  do {
+    submitted = Enter(fd_, queued_, 0, 0);
+  } while (submitted < 0 && errno == EINTR);
+  ASSERT(submitted >= 0, "Cannot submit to io_uring: %s", strerror(errno));
+  queued_ -= static_cast<unsigned>(submitted);
+  return true;
+}
+
+void Ring::ReadCompletion(unsigned index, uint64_t *user_data,
+                          int32_t *result) {
+  io_uring_cqe const &cqe = cqes_[index & cq_mask_];
+  *user_data = cqe.user_data;
+  *result = cqe.res;
+}
+
+} // namespace chloros
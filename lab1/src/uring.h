@@ -0,0 +1,84 @@
+#ifndef CHLOROS_SRC_URING_H_
+#define CHLOROS_SRC_URING_H_
+
+#include <cstddef>
+#include <cstdint>
+
+struct io_uring_cqe;
+struct io_uring_sqe;
+
+namespace chloros {
+
+// Just enough of io_uring for reads and writes, on the raw system calls, since
+// liburing is not something we can count on. A ring belongs to one kernel
+// thread and is not locked.
+class Ring {
+public:
+  Ring() = default;
+  ~Ring();
+  Ring(Ring const &) = delete;
+  Ring &operator=(Ring const &) = delete;
+
+  // Set up a ring with room for `entries` submissions, and twice as many
+  // completions. Returns false if the kernel does not let us have one.
+  bool Init(unsigned entries);
+
+  bool ready() const { return fd_ >= 0; }
+  // Becomes readable for epoll while there are completions to reap.
+  int fd() const { return fd_; }
+  unsigned completion_entries() const { return cq_entries_; }
+  // Submissions prepared but not handed to the kernel yet.
+  unsigned queued() const { return queued_; }
+
+  // Queue a read or write of `size` bytes at `offset`. Returns false if the
+  // submission queue is full; `Submit` makes room.
+  bool PrepareReadWrite(bool write, int fd, void *buffer, unsigned size,
+                        uint64_t offset, uint64_t user_data);
+
+  // Hand everything queued to the kernel in one system call. Returns false if
+  // there was nothing to submit.
+  bool Submit();
+
+  // Call `complete(user_data, result)` for every completion there is, where
+  // `result` is what the system call would have returned, or minus the error.
+  template <typename Complete> void Reap(Complete complete) {
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      uint64_t user_data;
+      int32_t result;
+      ReadCompletion(head, &user_data, &result);
+      complete(user_data, result);
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+  }
+
+private:
+  void ReadCompletion(unsigned index, uint64_t *user_data, int32_t *result);
+
+  int fd_ = -1;
+  unsigned queued_ = 0;
+
+  void *sq_ring_ = nullptr;
+  size_t sq_ring_size_ = 0;
+  void *cq_ring_ = nullptr;
+  size_t cq_ring_size_ = 0;
+  io_uring_sqe *sqes_ = nullptr;
+  size_t sqes_size_ = 0;
+
+  unsigned *sq_head_ = nullptr;
+  unsigned *sq_tail_ = nullptr;
+  unsigned sq_mask_ = 0;
+  unsigned sq_entries_ = 0;
+  unsigned *sq_array_ = nullptr;
+
+  unsigned *cq_head_ = nullptr;
+  unsigned *cq_tail_ = nullptr;
+  unsigned cq_mask_ = 0;
+  unsigned cq_entries_ = 0;
+  io_uring_cqe *cqes_ = nullptr;
+}; // class Ring
+
+} // namespace chloros
+
+#endif // CHLOROS_SRC_URING_H_
@@ -0,0 +1,197 @@
+#include <channel.h>
+#include <chloros.h>
+#include <common.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+chloros::Channel<int> numbers{2};
+std::vector<int> received{};
+
+void Sender(void*) {
+  for (int i = 0; i < 10; ++i) {
+    ASSERT(numbers.Send(i));
+  }
+  numbers.Close();
+}
+
+void Receiver(void*) {
+  int value;
+  while (numbers.Receive(&value)) {
+    received.push_back(value);
+  }
+}
+
+static void CheckSendReceive() {
+  chloros::Spawn(Receiver, nullptr);
+  // Parked on the empty channel.
+  ASSERT(chloros::GetThreadCount().first == 1);
+  chloros::Spawn(Sender, nullptr);
+  chloros::Wait();
+  ASSERT(received.size() == 10);
+  for (int i = 0; i < 10; ++i) {
+    ASSERT(received[i] == i, "Wrong order.");
+  }
+  ASSERT(numbers.closed());
+  int value = 0;
+  ASSERT(!numbers.Send(1));
+  ASSERT(!numbers.Receive(&value));
+}
+
+chloros::Channel<std::string> rendezvous{0};
+std::vector<std::string> events{};
+
+void RendezvousReceiver(void*) {
+  std::string value;
+  events.push_back("receiving");
+  ASSERT(rendezvous.Receive(&value));
+  events.push_back("got " + value);
+}
+
+static void CheckDirectHandoff() {
+  // A send to a parked receiver switches to it right away.
+  chloros::Spawn(RendezvousReceiver, nullptr);
+  ASSERT(rendezvous.Send("hello"));
+  events.push_back("sent");
+  chloros::Wait();
+  ASSERT((events ==
+          std::vector<std::string>{"receiving", "got hello", "sent"}));
+  // Nobody is receiving.
+  std::string value = "dropped";
+  ASSERT(!rendezvous.TrySend(value));
+  ASSERT(value == "dropped");
+}
+
+void BlockedSender(void* arg) {
+  ASSERT(reinterpret_cast<chloros::Channel<int>*>(arg)->Send(3));
+}
+
+static void CheckFullChannel() {
+  chloros::Channel<int> channel{1};
+  ASSERT(channel.Send(1));
+  int value = 2;
+  ASSERT(!channel.TrySend(value));
+  // The second send parks until there is room.
+  chloros::Spawn(BlockedSender, &channel);
+  ASSERT(channel.size() == 1);
+  ASSERT(channel.Receive(&value) && value == 1);
+  ASSERT(channel.size() == 1);
+  ASSERT(channel.TryReceive(&value) && value == 3);
+  ASSERT(!channel.TryReceive(&value));
+  chloros::Wait();
+
+  // Values still in the buffer are destroyed with it.
+  chloros::Channel<std::shared_ptr<int>> pointers{4};
+  auto pointer = std::make_shared<int>(1);
+  ASSERT(pointers.Send(pointer) && pointers.Send(pointer));
+}
+
+chloros::Channel<int> first{0};
+chloros::Channel<std::string> second{0};
+chloros::Channel<int> quit{0};
+
+void FirstSender(void*) { ASSERT(first.Send(1)); }
+void SecondSender(void*) { ASSERT(second.Send("two")); }
+void Quitter(void*) { quit.Close(); }
+
+static void CheckSelect() {
+  int number = 0;
+  std::string text{};
+  int ignored = 0;
+
+  chloros::Select idle{};
+  idle.Receive(first, &number);
+  idle.Receive(second, &text);
+  ASSERT(idle.TryWait() == -1);
+
+  chloros::SpawnDetached(SecondSender, nullptr);
+  chloros::SpawnDetached(FirstSender, nullptr);
+  std::vector<int> picked{};
+  for (int i = 0; i < 3; ++i) {
+    chloros::Select select{};
+    select.Receive(first, &number);
+    select.Receive(second, &text);
+    select.Receive(quit, &ignored);
+    if (i == 2) {
+      chloros::SpawnDetached(Quitter, nullptr);
+    }
+    picked.push_back(select.Wait());
+    ASSERT(select.ok() == (picked.back() != 2));
+  }
+  chloros::Wait();
+  // The senders run in the order they were spawned, except under LIFO.
+  std::vector<int> expected{1, 0, 2};
+  if (strcmp(chloros::GetSchedulingPolicy(), "lifo") == 0) {
+    expected = {0, 1, 2};
+  }
+  ASSERT(picked == expected, "Wrong cases picked.");
+  ASSERT(number == 1 && text == "two");
+}
+
+// Many producers and consumers, on several kernel threads.
+constexpr int const kKernelThreads = 4;
+constexpr int const kProducers = 8;
+constexpr int const kValuesPerProducer = 1000;
+
+chloros::Channel<int64_t> work{16};
+std::atomic<int64_t> sum{0};
+std::atomic<int> producers_left{kProducers};
+std::atomic<int> started{0};
+
+void Producer(void*) {
+  for (int i = 1; i <= kValuesPerProducer; ++i) {
+    ASSERT(work.Send(i));
+  }
+  if (--producers_left == 0) {
+    work.Close();
+  }
+}
+
+void Consumer(void*) {
+  int64_t value;
+  while (work.Receive(&value)) {
+    sum += value;
+  }
+}
+
+void KernelThreadWorker() {
+  chloros::Initialize();
+  started++;
+  while (started < kKernelThreads) {
+    std::this_thread::yield();
+  }
+  for (int i = 0; i < kProducers / kKernelThreads; ++i) {
+    chloros::SpawnDetached(Producer, nullptr);
+    chloros::SpawnDetached(Consumer, nullptr);
+  }
+  chloros::Wait();
+}
+
+static void CheckAcrossKernelThreads() {
+  std::vector<std::thread> threads{};
+  for (int i = 0; i < kKernelThreads; ++i) {
+    threads.emplace_back(KernelThreadWorker);
+  }
+  for (auto&& thread : threads) {
+    thread.join();
+  }
+  ASSERT(sum == int64_t{kProducers} * kValuesPerProducer *
+                    (kValuesPerProducer + 1) / 2,
+         "Lost values.");
+}
+
+int main() {
+  chloros::Initialize();
+  CheckSendReceive();
+  CheckDirectHandoff();
+  CheckFullChannel();
+  CheckSelect();
+  CheckAcrossKernelThreads();
+  LOG("Channel test passed!");
+  return 0;
+}
@@ -0,0 +1,166 @@
+#include <chloros.h>
+#include <common.h>
+#include <fiber_local.h>
+#include <runtime.h>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// Counts the instances that are alive.
+struct Tracked {
+  static std::atomic<int> alive;
+  static std::atomic<int> constructed;
+  Tracked() {
+    ++alive;
+    ++constructed;
+  }
+  ~Tracked() { --alive; }
+  intptr_t value = 0;
+};
+std::atomic<int> Tracked::alive{0};
+std::atomic<int> Tracked::constructed{0};
+
+chloros::FiberLocal<Tracked> tracked{};
+chloros::FiberLocal<int> counter{};
+
+// Threads that take turns keep their own values.
+constexpr int const kThreads = 10;
+constexpr int const kRounds = 20;
+
+void Counter(void* arg) {
+  auto id = reinterpret_cast<intptr_t>(arg);
+  ASSERT(!tracked.has_value());
+  tracked->value = id;
+  for (int i = 0; i < kRounds; ++i) {
+    ++*counter;
+    chloros::Yield();
+    ASSERT(tracked->value == id, "Thread %d sees the value of %d.",
+           static_cast<int>(id), static_cast<int>(tracked->value));
+  }
+  ASSERT(*counter == kRounds);
+}
+
+// Values are only made for threads that use them.
+void Bystander(void*) { chloros::Yield(); }
+
+static void CheckSeparate() {
+  for (int i = 0; i < kThreads; ++i) {
+    chloros::SpawnDetached(Counter, reinterpret_cast<void*>(intptr_t{i}));
+    chloros::SpawnDetached(Bystander, nullptr);
+  }
+  chloros::Wait();
+  ASSERT(Tracked::constructed == kThreads);
+  ASSERT(Tracked::alive == 0, "%d values left over.",
+         static_cast<int>(Tracked::alive));
+}
+
+static void CheckReset() {
+  Tracked::constructed = 0;
+  tracked->value = 42;
+  ASSERT(tracked.has_value());
+  tracked.reset();
+  ASSERT(!tracked.has_value());
+  ASSERT(Tracked::alive == 0);
+  ASSERT(tracked->value == 0);
+  ASSERT(Tracked::constructed == 2);
+  tracked.reset();
+}
+
+// Destructors run in order of slots, last first, and may use fiber-locals of
+// their own.
+std::vector<int> destroyed{};
+
+struct First {
+  ~First() { destroyed.push_back(1); }
+};
+struct Second {
+  ~Second();
+};
+
+chloros::FiberLocal<First> first{};
+chloros::FiberLocal<Second> second{};
+chloros::FiberLocal<Tracked> late{};
+
+Second::~Second() {
+  destroyed.push_back(2);
+  // Set after its turn, so it goes in the next round.
+  late->value = 1;
+}
+
+void Destructing(void*) {
+  first.get();
+  second.get();
+  // Blocking is fine too.
+  chloros::Yield();
+}
+
+static void CheckDestruction() {
+  Tracked::alive = 0;
+  chloros::Spawn(Destructing, nullptr).Join();
+  ASSERT((destroyed == std::vector<int>{2, 1}), "Wrong order.");
+  ASSERT(Tracked::alive == 0);
+}
+
+// Lots of slots.
+void ManySlots(void*) {
+  std::vector<chloros::FiberLocal<int>*> locals{};
+  for (int i = 0; i < 100; ++i) {
+    locals.push_back(new chloros::FiberLocal<int>{});
+    **locals.back() = i;
+  }
+  for (int i = 0; i < 100; ++i) {
+    ASSERT(**locals[i] == i);
+  }
+  // Values outlive their `FiberLocal`.
+  for (auto local : locals) {
+    delete local;
+  }
+}
+
+static void CheckManySlots() { chloros::Spawn(ManySlots, nullptr).Join(); }
+
+// Values go with threads that move between kernel threads.
+
+void Mover(void* arg) {
+  auto id = reinterpret_cast<intptr_t>(arg);
+  tracked->value = id;
+  for (int i = 0; i < 1000; ++i) {
+    chloros::Yield();
+    ASSERT(tracked->value == id);
+  }
+}
+
+static void CheckRuntime() {
+  Tracked::alive = 0;
+  {
+    chloros::RuntimeOptions options{};
+    options.workers = 4;
+    chloros::Runtime runtime{options};
+    for (int i = 0; i < 100; ++i) {
+      runtime.Spawn(Mover, reinterpret_cast<void*>(intptr_t{i}));
+    }
+  }
+  ASSERT(Tracked::alive == 0);
+}
+
+// Initializing again replaces the initial thread, whose values go with it.
+static void CheckReinitialize() {
+  Tracked::alive = 0;
+  tracked->value = 1;
+  ASSERT(Tracked::alive == 1);
+  chloros::Initialize();
+  ASSERT(Tracked::alive == 0, "Values of the initial thread leaked.");
+  ASSERT(!tracked.has_value());
+}
+
+int main() {
+  chloros::Initialize();
+  CheckSeparate();
+  CheckReset();
+  CheckDestruction();
+  CheckManySlots();
+  CheckRuntime();
+  CheckReinitialize();
+  LOG("Fiber local test passed!");
+  return 0;
+}
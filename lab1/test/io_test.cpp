@@ -0,0 +1,212 @@
+#include <chloros.h>
+#include <common.h>
+#include <io.h>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int pipe_fds[2];
+std::string pipe_received{};
+
+void PipeReader(void*) {
+  char buffer[16];
+  ssize_t n;
+  while ((n = chloros::io::Read(pipe_fds[0], buffer, sizeof(buffer))) > 0) {
+    pipe_received.append(buffer, n);
+  }
+  ASSERT(n == 0, "Read failed: %s", strerror(errno));
+}
+
+static void CheckPipe() {
+  ASSERT(pipe(pipe_fds) == 0);
+  chloros::JoinHandle reader = chloros::Spawn(PipeReader, nullptr);
+  // The reader is blocked on the empty pipe, but we are not.
+  ASSERT(!reader.Finished());
+  ASSERT(chloros::io::Write(pipe_fds[1], "hello", 5) == 5);
+  // Yielding looks for I/O every now and then, even with nothing else ready.
+  for (int i = 0; i < 1000 && pipe_received.empty(); ++i) {
+    chloros::Yield();
+  }
+  ASSERT(pipe_received == "hello");
+  ASSERT(chloros::io::Write(pipe_fds[1], " world", 6) == 6);
+  close(pipe_fds[1]);
+  reader.Join();
+  ASSERT(pipe_received == "hello world");
+  close(pipe_fds[0]);
+}
+
+// Many connections to an echo server, all on one kernel thread, waiting for
+// epoll or for io_uring.
+constexpr int const kConnections = 200;
+constexpr int const kMessages = 10;
+
+int listener = -1;
+sockaddr_in server_address{};
+int echoed = 0;
+
+void Echo(void* arg) {
+  int fd = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+  char buffer[64];
+  ssize_t n;
+  while ((n = chloros::io::Read(fd, buffer, sizeof(buffer))) > 0) {
+    ASSERT(chloros::io::Write(fd, buffer, n) == n);
+  }
+  close(fd);
+}
+
+void Acceptor(void*) {
+  for (int i = 0; i < kConnections; ++i) {
+    int fd = chloros::io::Accept(listener, nullptr, nullptr);
+    ASSERT(fd >= 0, "Accept failed: %s", strerror(errno));
+    chloros::SpawnDetached(Echo, reinterpret_cast<void*>(intptr_t{fd}));
+  }
+}
+
+void Client(void* arg) {
+  int id = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT(fd >= 0);
+  ASSERT(chloros::io::Connect(fd, reinterpret_cast<sockaddr*>(&server_address),
+                              sizeof(server_address)) == 0,
+         "Connect failed: %s", strerror(errno));
+  for (int i = 0; i < kMessages; ++i) {
+    std::string message = std::to_string(id) + ":" + std::to_string(i);
+    ASSERT(chloros::io::Write(fd, message.data(), message.size()) ==
+           static_cast<ssize_t>(message.size()));
+    std::string reply(message.size(), '\0');
+    size_t got = 0;
+    while (got < reply.size()) {
+      ssize_t n = chloros::io::Read(fd, &reply[got], reply.size() - got);
+      ASSERT(n > 0);
+      got += n;
+    }
+    ASSERT(reply == message, "Got %s back.", reply.c_str());
+  }
+  close(fd);
+  ++echoed;
+}
+
+static void CheckEchoServer(bool uring) {
+  chloros::io::SetUringSockets(uring);
+  echoed = 0;
+  listener = socket(AF_INET, SOCK_STREAM, 0);
+  ASSERT(listener >= 0);
+  server_address.sin_family = AF_INET;
+  server_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  server_address.sin_port = 0;
+  socklen_t length = sizeof(server_address);
+  ASSERT(bind(listener, reinterpret_cast<sockaddr*>(&server_address),
+              sizeof(server_address)) == 0);
+  ASSERT(getsockname(listener, reinterpret_cast<sockaddr*>(&server_address),
+                     &length) == 0);
+  ASSERT(listen(listener, kConnections) == 0);
+
+  chloros::SpawnDetached(Acceptor, nullptr);
+  for (int i = 0; i < kConnections; ++i) {
+    chloros::SpawnDetached(Client, reinterpret_cast<void*>(intptr_t{i}));
+  }
+  chloros::Wait();
+  ASSERT(echoed == kConnections, "Only %d clients done.", echoed);
+  close(listener);
+  chloros::io::SetUringSockets(false);
+}
+
+static void CheckConnectRefused() {
+  // Find a port nobody listens on.
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(address);
+  ASSERT(bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) ==
+         0);
+  ASSERT(getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) ==
+         0);
+  close(fd);
+
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  errno = 0;
+  ASSERT(chloros::io::Connect(fd, reinterpret_cast<sockaddr*>(&address),
+                              sizeof(address)) == -1);
+  ASSERT(errno == ECONNREFUSED, "Unexpected error: %s", strerror(errno));
+  close(fd);
+}
+
+// Blocks of a file written and read back by many threads at once, through
+// io_uring and through the helper threads.
+constexpr int const kBlocks = 64;
+constexpr int const kBlockSize = 4096;
+
+int file = -1;
+
+void WriteBlock(void* arg) {
+  auto block = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+  char buffer[kBlockSize];
+  memset(buffer, 'a' + block % 26, sizeof(buffer));
+  ASSERT(chloros::io::PWrite(file, buffer, sizeof(buffer),
+                             off_t{block} * kBlockSize) == kBlockSize);
+}
+
+void ReadBlock(void* arg) {
+  auto block = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+  char buffer[kBlockSize];
+  ASSERT(chloros::io::PRead(file, buffer, sizeof(buffer),
+                            off_t{block} * kBlockSize) == kBlockSize);
+  for (char c : buffer) {
+    ASSERT(c == 'a' + block % 26, "Block %d is corrupt.", block);
+  }
+}
+
+static void CheckFile(bool uring) {
+  chloros::io::SetUring(uring);
+  char path[] = "/tmp/chloros_io_test_XXXXXX";
+  file = mkstemp(path);
+  ASSERT(file >= 0);
+  unlink(path);
+  auto before = chloros::io::GetFileIoStats();
+  for (int i = 0; i < kBlocks; ++i) {
+    chloros::SpawnDetached(WriteBlock, reinterpret_cast<void*>(intptr_t{i}));
+  }
+  chloros::Wait();
+  for (int i = 0; i < kBlocks; ++i) {
+    chloros::SpawnDetached(ReadBlock, reinterpret_cast<void*>(intptr_t{i}));
+  }
+  chloros::Wait();
+  auto after = chloros::io::GetFileIoStats();
+  ASSERT(after.operations - before.operations == 2 * kBlocks);
+  if (uring) {
+    // Submitted in a few batches, not one by one.
+    ASSERT(after.system_calls - before.system_calls < kBlocks,
+           "%d system calls.",
+           static_cast<int>(after.system_calls - before.system_calls));
+  }
+
+  // Past the end of the file, and errors.
+  char buffer[16];
+  ASSERT(chloros::io::PRead(file, buffer, sizeof(buffer),
+                            off_t{kBlocks} * kBlockSize) == 0);
+  close(file);
+  errno = 0;
+  ASSERT(chloros::io::PRead(file, buffer, sizeof(buffer), 0) == -1);
+  ASSERT(errno == EBADF, "Unexpected error: %s", strerror(errno));
+  chloros::io::SetUring(true);
+}
+
+int main() {
+  chloros::Initialize();
+  CheckPipe();
+  CheckEchoServer(false);
+  CheckEchoServer(true);
+  CheckConnectRefused();
+  CheckFile(true);
+  CheckFile(false);
+  LOG("IO test passed!");
+  return 0;
+}
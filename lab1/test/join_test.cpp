@@ -0,0 +1,127 @@
+#include <chloros.h>
+#include <common.h>
+#include <future.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+std::vector<int> order{};
+
+void Worker(void* arg) {
+  chloros::Yield();
+  order.push_back(*reinterpret_cast<int*>(&arg));
+}
+
+static void CheckJoin() {
+  order.clear();
+  auto first = chloros::Spawn(Worker, reinterpret_cast<void*>(1));
+  auto second = chloros::Spawn(Worker, reinterpret_cast<void*>(2));
+  ASSERT(!second.Finished());
+  // Joining the second one must not return before it is done, whatever the
+  // order in which they finish.
+  second.Join();
+  ASSERT(second.Finished());
+  ASSERT(order.size() == 2 && order[1] == 2);
+  first.Join();
+  ASSERT(first.Finished());
+  // Joining again returns right away, also once the thread is reclaimed.
+  chloros::GarbageCollect();
+  first.Join();
+  ASSERT(chloros::GetThreadCount() == std::make_pair(0, 0));
+}
+
+void Sleeper(void*) {
+  for (int i = 0; i < 100; ++i) {
+    chloros::Yield();
+  }
+}
+
+void Joiner(void* arg) {
+  reinterpret_cast<chloros::JoinHandle*>(arg)->Join();
+  order.push_back(0);
+}
+
+static void CheckJoinParks() {
+  order.clear();
+  chloros::JoinHandle sleeper = chloros::Spawn(Sleeper, nullptr);
+  chloros::Spawn(Joiner, &sleeper);
+  chloros::Spawn(Joiner, &sleeper);
+  // The joiners are parked, not queued.
+  ASSERT(chloros::GetThreadCount().first == 3);
+  chloros::Wait();
+  ASSERT(order.size() == 2);
+}
+
+int Square(void* arg) {
+  chloros::Yield();
+  int x = *reinterpret_cast<int*>(&arg);
+  return x * x;
+}
+
+std::string Greet(void*) { return "hello"; }
+
+static void CheckFuture() {
+  std::vector<chloros::Future<int>> futures{};
+  for (int i = 0; i < 10; ++i) {
+    futures.push_back(chloros::Spawn(Square, reinterpret_cast<void*>(i)));
+  }
+  for (int i = 0; i < 10; ++i) {
+    ASSERT(futures[i].Get() == i * i, "Wrong result.");
+    ASSERT(futures[i].Ready());
+  }
+  auto greeting = chloros::Spawn(Greet, nullptr);
+  ASSERT(greeting.Get() == "hello");
+  // A future dropped before its thread is done must not leak or crash.
+  { chloros::Spawn(Square, reinterpret_cast<void*>(3)); }
+  chloros::Wait();
+  chloros::GarbageCollect();
+}
+
+// Fork/join across kernel threads: whichever kernel thread finishes the
+// worker wakes up the joiner on its own.
+std::atomic<bool> stop{false};
+
+void KernelThreadWorker() {
+  chloros::Initialize();
+  while (!stop) {
+    chloros::Yield(true);
+  }
+  chloros::Wait();
+}
+
+int Sum(void* arg) {
+  int n = *reinterpret_cast<int*>(&arg);
+  int sum = 0;
+  for (int i = 0; i < n; ++i) {
+    sum += i;
+    chloros::Yield();
+  }
+  return sum;
+}
+
+static void CheckJoinAcrossKernelThreads() {
+  std::thread peer{KernelThreadWorker};
+  std::vector<chloros::Future<int>> futures{};
+  for (int i = 0; i < 50; ++i) {
+    futures.push_back(chloros::Spawn(Sum, reinterpret_cast<void*>(i)));
+  }
+  for (int i = 0; i < 50; ++i) {
+    ASSERT(futures[i].Get() == i * (i - 1) / 2, "Wrong result.");
+  }
+  stop = true;
+  peer.join();
+  chloros::Wait();
+}
+
+int main() {
+  chloros::Initialize();
+  CheckJoin();
+  CheckJoinParks();
+  CheckFuture();
+  CheckJoinAcrossKernelThreads();
+  LOG("Join test passed!");
+  return 0;
+}
@@ -0,0 +1,117 @@
+#include <chloros.h>
+#include <common.h>
+#include <parallel.h>
+#include <runtime.h>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+constexpr int const kSize = 100000;
+constexpr size_t const kGrain = 64;
+
+// Indices [begin, end) reduced in order, as far as `ordered` tells.
+struct Span {
+  int begin;
+  int end;
+  bool ordered;
+};
+
+Span const kEmpty{0, 0, true};
+
+Span Combine(Span left, Span right) {
+  if (left.begin == left.end) {
+    return right;
+  }
+  if (right.begin == right.end) {
+    return left;
+  }
+  return Span{left.begin, right.end,
+              left.ordered && right.ordered && left.end == right.begin};
+}
+
+Span Reduce(int begin, int end, size_t grain) {
+  return chloros::ParallelReduce(
+      begin, end, grain, kEmpty, [](int i) { return Span{i, i + 1, true}; },
+      Combine);
+}
+
+std::vector<std::atomic<int>> visits(kSize);
+
+static void CheckVisitedOnce(int begin, int end) {
+  for (int i = 0; i < kSize; ++i) {
+    int expected = begin <= i && i < end ? 1 : 0;
+    ASSERT(visits[i].exchange(0) == expected, "Index %d visited wrongly.", i);
+  }
+}
+
+static void Visit(int begin, int end, size_t grain) {
+  chloros::ParallelFor(begin, end, grain, [](int i) { ++visits[i]; });
+  CheckVisitedOnce(begin, end);
+}
+
+// Without peers there is nobody to split for, so nothing is spawned.
+static void CheckSequential() {
+  chloros::SchedulerStats before = chloros::GetSchedulerStats();
+  Visit(0, kSize, kGrain);
+  Visit(10, 20, kGrain);
+  Visit(5, 5, kGrain);
+  Visit(7, 3, kGrain);
+  Visit(0, kSize, 0);
+  Span span = Reduce(0, kSize, kGrain);
+  ASSERT(span.begin == 0 && span.end == kSize && span.ordered);
+  span = Reduce(3, 3, kGrain);
+  ASSERT(span.begin == span.end);
+  chloros::SchedulerStats after = chloros::GetSchedulerStats();
+  ASSERT(after.total.spawns == before.total.spawns, "Spawned threads.");
+
+  // Other index types, and results that are not default constructible.
+  uint64_t sum = chloros::ParallelReduce(
+      uint64_t{1}, uint64_t{1001}, 7, uint64_t{0},
+      [](uint64_t i) { return i; },
+      [](uint64_t a, uint64_t b) { return a + b; });
+  ASSERT(sum == 500500);
+}
+
+// On a runtime, workers that run out of work get their share.
+std::atomic<bool> done{false};
+std::atomic<uint64_t> spawned{0};
+
+void Batch(void*) {
+  chloros::SchedulerStats before = chloros::GetSchedulerStats();
+  Visit(0, kSize, kGrain);
+  Visit(0, kSize, 1);
+  Visit(0, 100, kGrain);
+  for (size_t grain : {size_t{1}, size_t{16}, kGrain, size_t{kSize}}) {
+    Span span = Reduce(0, kSize, grain);
+    ASSERT(span.begin == 0 && span.end == kSize && span.ordered,
+           "Wrong reduction with grain %zu.", grain);
+  }
+  // Nested loops split too.
+  chloros::ParallelFor(0, 100, 1, [](int i) {
+    chloros::ParallelFor(0, 1000, 10, [i](int j) { ++visits[i * 1000 + j]; });
+  });
+  CheckVisitedOnce(0, kSize);
+  spawned = chloros::GetSchedulerStats().total.spawns - before.total.spawns;
+  done = true;
+}
+
+static void CheckRuntime() {
+  chloros::RuntimeOptions options{};
+  options.workers = 4;
+  options.pin_workers = false;
+  chloros::Runtime runtime{options};
+  runtime.Spawn(Batch, nullptr);
+  runtime.Shutdown();
+  ASSERT(done);
+  if (chloros::GetSchedulerStats().enabled) {
+    ASSERT(spawned > 0, "Nothing was split off.");
+  }
+}
+
+int main() {
+  chloros::Initialize();
+  CheckSequential();
+  CheckRuntime();
+  LOG("Parallel test passed!");
+  return 0;
+}
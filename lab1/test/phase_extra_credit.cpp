@@ -1,5 +1,6 @@
 #include <chloros.h>
 #include <atomic>
+#include <cstdio>
 #include <thread>
 #include <vector>
 
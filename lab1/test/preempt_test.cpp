@@ -0,0 +1,147 @@
+#include <chloros.h>
+#include <common.h>
+#include <sync.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+
+using Clock = std::chrono::steady_clock;
+
+constexpr std::chrono::milliseconds const kTimeSlice{1};
+
+std::atomic<bool> done{false};
+
+// Never yields on its own.
+void Spinner(void*) {
+  while (!done) {
+  }
+}
+
+// CPU time of this kernel thread, which is what time slices are made of. Wall
+// clock time also counts whatever else the machine is busy with.
+std::chrono::nanoseconds CpuTime() {
+  timespec now{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+  return std::chrono::seconds{now.tv_sec} +
+         std::chrono::nanoseconds{now.tv_nsec};
+}
+
+// Wakes up regularly, and keeps track of how long it had to wait.
+constexpr int const kRounds = 50;
+std::chrono::nanoseconds max_gap{};
+
+void LatencySensitive(void*) {
+  auto last = CpuTime();
+  for (int i = 0; i < kRounds; ++i) {
+    chloros::Yield();
+    auto now = CpuTime();
+    max_gap = std::max(max_gap, now - last);
+    last = now;
+  }
+  done = true;
+}
+
+static void CheckFairness() {
+  done = false;
+  chloros::SpawnDetached(Spinner, nullptr);
+  chloros::SpawnDetached(LatencySensitive, nullptr);
+  chloros::Wait();
+  ASSERT(done);
+  auto gap = std::chrono::duration_cast<std::chrono::milliseconds>(max_gap);
+  // Just a few time slices, no matter how long the spinner would like to run.
+  ASSERT(gap < 100 * kTimeSlice, "Waited for %ld ms.",
+         static_cast<long>(gap.count()));
+}
+
+// Vector registers must survive being preempted at any instruction.
+constexpr int const kTerms = 20000000;
+double results[2];
+
+void Sum(void* arg) {
+  auto index = reinterpret_cast<intptr_t>(arg);
+  double sign = index == 0 ? 1.0 : -1.0;
+  double sum = 0;
+  for (int i = 1; i <= kTerms; ++i) {
+    sum += sign / (static_cast<double>(i) * i);
+  }
+  results[index] = sum;
+}
+
+static void CheckVectorState() {
+  chloros::SpawnDetached(Sum, reinterpret_cast<void*>(0));
+  chloros::SpawnDetached(Sum, reinterpret_cast<void*>(1));
+  chloros::Wait();
+  double expected = 0;
+  for (int i = 1; i <= kTerms; ++i) {
+    expected += 1.0 / (static_cast<double>(i) * i);
+  }
+  ASSERT(results[0] == expected && results[1] == -expected,
+         "Vector state got corrupted.");
+}
+
+// A no-preemption region keeps everyone else out for as long as it lasts.
+std::atomic<int> ticks{0};
+
+void Ticker(void*) {
+  while (!done) {
+    ++ticks;
+  }
+}
+
+void Critical(void*) {
+  chloros::NoPreemptGuard guard{};
+  int before = ticks;
+  auto end = Clock::now() + 20 * kTimeSlice;
+  while (Clock::now() < end) {
+  }
+  ASSERT(ticks == before, "Preempted in a no-preemption region.");
+  done = true;
+}
+
+static void CheckNoPreemptRegion() {
+  done = false;
+  chloros::SpawnDetached(Critical, nullptr);
+  chloros::SpawnDetached(Ticker, nullptr);
+  chloros::Wait();
+  ASSERT(done);
+}
+
+// Threads are preempted all over the scheduler and the mutex, which must not
+// break either.
+constexpr int const kIncrementers = 8;
+constexpr int const kIncrements = 200000;
+
+chloros::Mutex mutex{};
+int64_t counter = 0;
+
+void Incrementer(void*) {
+  for (int i = 0; i < kIncrements; ++i) {
+    mutex.lock();
+    ++counter;
+    mutex.unlock();
+  }
+}
+
+static void CheckLocks() {
+  for (int i = 0; i < kIncrementers; ++i) {
+    chloros::SpawnDetached(Incrementer, nullptr);
+  }
+  chloros::Wait();
+  ASSERT(counter == int64_t{kIncrementers} * kIncrements, "Lost updates.");
+}
+
+int main() {
+  chloros::Initialize();
+  chloros::SetTimeSlice(kTimeSlice);
+  chloros::SetPreemption(true);
+  CheckFairness();
+  CheckVectorState();
+  CheckNoPreemptRegion();
+  CheckLocks();
+  chloros::SetPreemption(false);
+  LOG("Preempt test passed!");
+  return 0;
+}
@@ -0,0 +1,142 @@
+#include <channel.h>
+#include <chloros.h>
+#include <common.h>
+#include <runtime.h>
+#include <sync.h>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <thread>
+
+constexpr int const kWorkers = 4;
+
+// Kernel threads that green threads ran on.
+std::mutex seen_lock{};
+std::set<std::thread::id> seen{};
+
+void Record() {
+  std::lock_guard<std::mutex> lock{seen_lock};
+  seen.insert(std::this_thread::get_id());
+}
+
+std::atomic<int> finished{0};
+
+void Counted(void*) { ++finished; }
+
+static void CheckSpawnFromOutside() {
+  chloros::RuntimeOptions options{};
+  options.workers = kWorkers;
+  chloros::Runtime runtime{options};
+  ASSERT(runtime.workers() == kWorkers);
+  finished = 0;
+  for (int i = 0; i < 1000; ++i) {
+    runtime.Spawn(Counted, nullptr);
+  }
+  runtime.Shutdown();
+  ASSERT(finished == 1000, "Only %d threads ran.", finished.load());
+  // Shutting down twice is fine.
+  runtime.Shutdown();
+}
+
+// Threads spawned by one green thread start out on its worker, and spread to
+// the others from there.
+constexpr int const kBusyThreads = 64;
+
+void Busy(void*) {
+  for (int i = 0; i < 20; ++i) {
+    Record();
+    auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(50);
+    while (std::chrono::steady_clock::now() < end) {
+    }
+    chloros::Yield();
+  }
+  ++finished;
+}
+
+void FanOut(void* arg) {
+  auto runtime = static_cast<chloros::Runtime*>(arg);
+  for (int i = 0; i < kBusyThreads; ++i) {
+    runtime->Spawn(Busy, nullptr);
+  }
+}
+
+static void CheckMigration() {
+  chloros::RuntimeOptions options{};
+  options.workers = kWorkers;
+  chloros::Runtime runtime{options};
+  finished = 0;
+  seen.clear();
+  runtime.Spawn(FanOut, &runtime);
+  runtime.Shutdown();
+  ASSERT(finished == kBusyThreads);
+  ASSERT(seen.size() > 1, "Nothing migrated.");
+}
+
+// Shutting down waits for threads that are blocked, and for the threads that
+// others spawn while it does.
+chloros::Channel<int> pipe{0};
+std::atomic<int64_t> sum{0};
+
+void PipeReceiver(void*) {
+  int value;
+  while (pipe.Receive(&value)) {
+    sum += value;
+  }
+}
+
+void PipeSender(void*) {
+  for (int i = 1; i <= 100; ++i) {
+    ASSERT(pipe.Send(i));
+  }
+  pipe.Close();
+}
+
+void Parent(void* arg) {
+  auto runtime = static_cast<chloros::Runtime*>(arg);
+  chloros::JoinHandle child = runtime->Spawn(Counted, nullptr);
+  child.Join();
+  ASSERT(child.Finished());
+  // Still running when the runtime is told to shut down.
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  runtime->Spawn(PipeSender, nullptr);
+}
+
+static void CheckDrain() {
+  chloros::RuntimeOptions options{};
+  options.workers = kWorkers;
+  chloros::Runtime runtime{options};
+  finished = 0;
+  runtime.Spawn(PipeReceiver, nullptr);
+  runtime.Spawn(Parent, &runtime);
+  runtime.Shutdown();
+  ASSERT(finished == 1);
+  ASSERT(sum == 5050, "Lost values.");
+}
+
+static void CheckPreemption() {
+  chloros::RuntimeOptions options{};
+  options.workers = 2;
+  options.preemption = true;
+  options.pin_workers = false;
+  finished = 0;
+  {
+    chloros::Runtime runtime{options};
+    for (int i = 0; i < 16; ++i) {
+      runtime.Spawn(Counted, nullptr);
+    }
+    // The destructor drains the runtime.
+  }
+  ASSERT(finished == 16);
+}
+
+int main() {
+  CheckSpawnFromOutside();
+  CheckMigration();
+  CheckDrain();
+  CheckPreemption();
+  LOG("Runtime test passed!");
+  return 0;
+}
@@ -0,0 +1,162 @@
+#include <chloros.h>
+#include <common.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+// Counts allocations, to check that spawning a closure makes none.
+long allocations = 0;
+
+void* operator new(std::size_t size) {
+  ++allocations;
+  void* block = malloc(size);
+  if (block == nullptr) {
+    throw std::bad_alloc{};
+  }
+  return block;
+}
+
+void operator delete(void* block) noexcept { free(block); }
+void operator delete(void* block, std::size_t) noexcept { free(block); }
+
+std::vector<int> order{};
+
+// Threads spawned without running run in the order they were spawned, except
+// under LIFO, which runs the latest first.
+static bool Lifo() {
+  return strcmp(chloros::GetSchedulingPolicy(), "lifo") == 0;
+}
+
+void Worker(void* arg) { order.push_back(*reinterpret_cast<int*>(&arg)); }
+
+static void CheckSpawnDetached() {
+  order.clear();
+  for (int i = 0; i < 3; ++i) {
+    chloros::SpawnDetached(Worker, reinterpret_cast<void*>(i));
+  }
+  // Nothing ran yet.
+  ASSERT(order.empty());
+  ASSERT(chloros::GetThreadCount().first == 3);
+  chloros::Wait();
+  std::vector<int> expected{0, 1, 2};
+  if (Lifo()) {
+    expected = {2, 1, 0};
+  }
+  ASSERT(order == expected, "Wrong order.");
+}
+
+static void CheckSpawnMany() {
+  constexpr int const kThreads = 100;
+  order.clear();
+  std::vector<void*> args{};
+  for (int i = 0; i < kThreads; ++i) {
+    args.push_back(reinterpret_cast<void*>(i));
+  }
+  chloros::SpawnMany(Worker, args.data(), args.size());
+  ASSERT(order.empty());
+  ASSERT(chloros::GetThreadCount().first == kThreads);
+  // Eager spawns still go first.
+  chloros::Spawn(Worker, reinterpret_cast<void*>(-1));
+  chloros::Wait();
+  ASSERT(order.size() == kThreads + 1);
+  ASSERT(order[0] == -1);
+  for (int i = 0; i < kThreads; ++i) {
+    ASSERT(order[i + 1] == (Lifo() ? kThreads - 1 - i : i), "Wrong order.");
+  }
+  ASSERT(chloros::GetThreadCount().first == 0);
+}
+
+static void CheckSpawnManyEmpty() {
+  chloros::SpawnMany(Worker, nullptr, 0);
+  ASSERT(chloros::Yield() == false);
+}
+
+// Counts the copies of it that are alive.
+struct Tracked {
+  static int alive;
+  Tracked() { ++alive; }
+  Tracked(Tracked const&) { ++alive; }
+  Tracked(Tracked&&) noexcept { ++alive; }
+  ~Tracked() { --alive; }
+};
+int Tracked::alive = 0;
+
+struct alignas(64) Aligned {
+  char bytes[64];
+};
+
+static void CheckClosures() {
+  order.clear();
+  int x = 1;
+  // Lambdas run right away, like any other spawn.
+  chloros::Spawn([&order = order, x] { order.push_back(x); });
+  ASSERT((order == std::vector<int>{1}));
+  // Arguments are copied or moved along, including move-only ones.
+  std::string text{"moved"};
+  auto number = std::make_unique<int>(42);
+  chloros::Spawn(
+      [](std::string const& s, std::unique_ptr<int> n, int y) {
+        ASSERT(s == "moved");
+        ASSERT(*n == 42 && y == 7);
+      },
+      std::move(text), std::move(number), 7)
+      .Join();
+  ASSERT(number == nullptr);
+  // Plain functions with arguments of any type.
+  chloros::SpawnDetached(+[](int y) { order.push_back(y); }, 2);
+  chloros::SpawnDetached(chloros::SpawnOptions{1 << 14, false},
+                         [](int y) { order.push_back(y); }, 3);
+  chloros::Wait();
+  std::vector<int> expected{1, 2, 3};
+  if (Lifo()) {
+    expected = {1, 3, 2};
+  }
+  ASSERT(order == expected, "Wrong order.");
+}
+
+static void CheckClosureStorage() {
+  // The capture lives on the new stack, suitably aligned, and is destroyed
+  // when the thread is done.
+  Tracked tracked{};
+  Aligned aligned{};
+  auto closure = [tracked, aligned] {
+    // Ours, the one in `closure`, and the one in this copy of it.
+    ASSERT(Tracked::alive == 3);
+    ASSERT(reinterpret_cast<uintptr_t>(&aligned) % alignof(Aligned) == 0);
+    chloros::Thread* self = chloros::CurrentThread();
+    auto address = reinterpret_cast<uint8_t const*>(&tracked);
+    ASSERT(address < self->stack && address >= self->stack - self->stack_size);
+    chloros::Yield();
+  };
+  chloros::JoinHandle handle = chloros::Spawn(closure);
+  handle.Join();
+  ASSERT(Tracked::alive == 2);
+  // In steady state, spawning one allocates nothing.
+  std::string text{"a string too long to be stored inline"};
+  for (int i = 0; i < 3; ++i) {
+    long before = allocations;
+    chloros::Spawn([text, i] { ASSERT(text.size() > 20 && i < 3); });
+    if (i > 0) {
+      // Copying the string is the only one.
+      ASSERT(allocations - before == 1, "%ld allocations.",
+             allocations - before);
+    }
+  }
+  chloros::Wait();
+}
+
+int main() {
+  chloros::Initialize();
+  CheckSpawnDetached();
+  CheckSpawnMany();
+  CheckSpawnManyEmpty();
+  CheckClosures();
+  CheckClosureStorage();
+  LOG("Spawn test passed!");
+  return 0;
+}
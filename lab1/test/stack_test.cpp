@@ -0,0 +1,153 @@
+#include <chloros.h>
+#include <common.h>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <set>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+static void CheckStackSize() {
+  chloros::SpawnOptions options{};
+  options.stack_size = 100000;
+  auto&& thread = chloros::Thread(true, options);
+  ASSERT(thread.stack_size == 1 << 17, "Stack size not rounded up.");
+  ASSERT(reinterpret_cast<intptr_t>(thread.stack) % 16 == 0,
+         "Stack is not aligned to 16 bytes.");
+  // The whole stack must be usable.
+  thread.stack[-1] = 1;
+  thread.stack[-static_cast<intptr_t>(thread.stack_size)] = 1;
+}
+
+static void CheckMinimumStackSize() {
+  chloros::SpawnOptions options{};
+  options.stack_size = 1;
+  auto&& thread = chloros::Thread(true, options);
+  ASSERT(thread.stack_size == 1 << 14, "Stack size not rounded up.");
+}
+
+static void CheckGuardPage() {
+  auto&& thread = chloros::Thread(true);
+  pid_t pid = fork();
+  ASSERT(pid >= 0, "Cannot fork.");
+  if (pid == 0) {
+    // Right below the stack, so this must fault.
+    *reinterpret_cast<volatile uint8_t*>(
+        thread.stack - thread.stack_size - 1) = 1;
+    _exit(0);
+  }
+  int status;
+  ASSERT(waitpid(pid, &status, 0) == pid);
+  ASSERT(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV,
+         "Guard page is accessible.");
+}
+
+static void CheckStackReuse() {
+  auto thread = std::make_unique<chloros::Thread>(true);
+  uint8_t* stack = thread->stack;
+  thread.reset();
+  thread = std::make_unique<chloros::Thread>(true);
+  ASSERT(thread->stack == stack, "Stack is not recycled.");
+
+  chloros::SetStackCacheLimit(0);
+  thread.reset();
+  chloros::SetStackCacheLimit(16);
+
+  // Many more small stacks than default ones are kept.
+  chloros::SpawnOptions options{};
+  options.stack_size = 1 << 14;
+  std::vector<std::unique_ptr<chloros::Thread>> threads{};
+  std::set<uint8_t*> stacks{};
+  for (int i = 0; i < 1000; ++i) {
+    threads.push_back(std::make_unique<chloros::Thread>(true, options));
+    stacks.insert(threads.back()->stack);
+  }
+  threads.clear();
+  for (int i = 0; i < 1000; ++i) {
+    threads.push_back(std::make_unique<chloros::Thread>(true, options));
+    ASSERT(stacks.count(threads.back()->stack) == 1,
+           "Small stack %d is not recycled.", i);
+  }
+}
+
+int counter = 0;
+
+void Worker(void*) {
+  uint8_t deep[1 << 16];
+  deep[0] = 1;
+  counter += deep[0];
+}
+
+static void CheckSpawnWithOptions() {
+  chloros::Initialize();
+  chloros::SpawnOptions options{};
+  options.stack_size = 1 << 17;
+  options.guard_page = false;
+  chloros::Spawn(Worker, nullptr, options);
+  chloros::Wait();
+  ASSERT(counter == 1);
+}
+
+constexpr size_t const kDeepBytes = 100000;
+
+void DeepWorker(void*) {
+  volatile uint8_t deep[kDeepBytes];
+  for (size_t i = 0; i < kDeepBytes; i += 512) {
+    deep[i] = 1;
+  }
+  ASSERT(deep[0] == 1);
+}
+
+void ShallowWorker(void*) {}
+
+static void CheckStackPainting() {
+  chloros::SetStackPainting(true);
+  for (int i = 0; i < 3; ++i) {
+    chloros::Spawn(DeepWorker, nullptr);
+    chloros::Spawn(ShallowWorker, nullptr);
+  }
+  chloros::Wait();
+  chloros::SetStackPainting(false);
+
+  auto deep = chloros::GetStackUsage(DeepWorker);
+  ASSERT(deep.threads == 3);
+  ASSERT(deep.max_bytes >= kDeepBytes, "Stack use underestimated.");
+  ASSERT(deep.max_bytes < kDeepBytes + 8192, "Stack use overestimated.");
+  ASSERT(deep.total_bytes >= 3 * kDeepBytes);
+
+  auto shallow = chloros::GetStackUsage(ShallowWorker);
+  ASSERT(shallow.threads == 3);
+  // Only the debug log on exit takes a few KB.
+  ASSERT(shallow.max_bytes < 16384, "Stack use overestimated.");
+
+  ASSERT(chloros::GetStackUsage(Worker).threads == 0);
+  ASSERT(chloros::GetStackUsageReport().size() == 2);
+}
+
+static void CheckAdaptiveStackSize() {
+  // Once sized after what was recorded, deep threads must still fit.
+  chloros::SetAdaptiveStackSize(true);
+  for (int i = 0; i < 3; ++i) {
+    chloros::Spawn(DeepWorker, nullptr);
+    chloros::Spawn(ShallowWorker, nullptr);
+  }
+  chloros::Wait();
+  chloros::SetAdaptiveStackSize(false);
+  chloros::SetStackPainting(false);
+  ASSERT(chloros::GetStackUsage(DeepWorker).threads == 6);
+  ASSERT(chloros::GetStackUsage(DeepWorker).max_bytes < kDeepBytes + 8192);
+}
+
+int main() {
+  CheckStackSize();
+  CheckMinimumStackSize();
+  CheckGuardPage();
+  CheckStackReuse();
+  CheckSpawnWithOptions();
+  CheckStackPainting();
+  CheckAdaptiveStackSize();
+  LOG("Stack test passed!");
+  return 0;
+}
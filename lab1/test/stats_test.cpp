@@ -0,0 +1,131 @@
+#include <chloros.h>
+#include <common.h>
+#include <runtime.h>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+constexpr int const kThreads = 10;
+constexpr int const kYields = 5;
+
+void Yielder(void*) {
+  for (int i = 0; i < kYields; ++i) {
+    chloros::Yield();
+  }
+}
+
+// Spawns, exits and switches are all counted, on this kernel thread.
+static void CheckCounters() {
+  chloros::SchedulerStats before = chloros::GetSchedulerStats();
+  for (int i = 0; i < kThreads; ++i) {
+    chloros::SpawnDetached(Yielder, nullptr);
+  }
+  ASSERT(chloros::GetSchedulerStats().total.run_queue_depth >=
+         before.total.run_queue_depth + kThreads);
+  chloros::Wait();
+  ASSERT(!chloros::Yield());
+  chloros::SchedulerStats after = chloros::GetSchedulerStats();
+  ASSERT(after.enabled);
+  ASSERT(after.kernel_threads.size() == 1);
+  ASSERT(after.total.spawns - before.total.spawns == kThreads);
+  ASSERT(after.total.exits - before.total.exits == kThreads);
+  ASSERT(after.total.empty_yields - before.total.empty_yields >= 1);
+  // Each thread runs kYields + 1 times.
+  uint64_t switches =
+      after.total.context_switches - before.total.context_switches;
+  ASSERT(switches >= kThreads * (kYields + 1), "%d switches.",
+         static_cast<int>(switches));
+  ASSERT(after.total.busy_cycles > before.total.busy_cycles);
+  ASSERT(after.total.run_queue_depth == 0);
+}
+
+// The per-thread breakdown charges a busy thread more time than an idle one.
+volatile uint64_t sink = 0;
+
+void Spinner(void*) {
+  uint64_t x = 1;
+  for (int i = 0; i < 1000000; ++i) {
+    x = x * 6364136223846793005u + 1;
+  }
+  sink = x;
+  chloros::Yield();
+}
+
+static uint64_t CyclesOf(chloros::SchedulerStats const& stats, uint64_t id) {
+  for (chloros::ThreadStats const& thread : stats.threads) {
+    if (thread.id == id) {
+      return thread.cycles;
+    }
+  }
+  return 0;
+}
+
+static void CheckPerThread() {
+  chloros::SetPerThreadStats(true);
+  chloros::JoinHandle spinner = chloros::Spawn(Spinner, nullptr);
+  chloros::JoinHandle yielder = chloros::Spawn(Yielder, nullptr);
+  uint64_t spinner_id = spinner.id();
+  uint64_t yielder_id = yielder.id();
+  spinner.Join();
+  yielder.Join();
+  chloros::SchedulerStats stats = chloros::GetSchedulerStats();
+  chloros::SetPerThreadStats(false);
+  uint64_t spinner_cycles = CyclesOf(stats, spinner_id);
+  uint64_t yielder_cycles = CyclesOf(stats, yielder_id);
+  ASSERT(yielder_cycles > 0);
+  ASSERT(spinner_cycles > 10 * yielder_cycles);
+  for (size_t i = 1; i < stats.threads.size(); ++i) {
+    ASSERT(stats.threads[i - 1].id < stats.threads[i].id);
+  }
+  // Turning it on again starts afresh.
+  chloros::SetPerThreadStats(true);
+  ASSERT(CyclesOf(chloros::GetSchedulerStats(), spinner_id) == 0);
+  chloros::SetPerThreadStats(false);
+}
+
+// Spawns from outside the workers count too, and work moves between them.
+// Time only ever adds up, even read while the workers run.
+void Sleeper(void*) { chloros::SleepFor(std::chrono::milliseconds{1}); }
+
+static void CheckRuntime() {
+  chloros::SchedulerStats before = chloros::GetSchedulerStats();
+  {
+    chloros::RuntimeOptions options{};
+    options.workers = 2;
+    chloros::Runtime runtime{options};
+    std::atomic<bool> done{false};
+    std::thread reader{[&done] {
+      chloros::SchedulerCounters last{};
+      while (!done) {
+        chloros::SchedulerCounters now = chloros::GetSchedulerStats().total;
+        ASSERT(now.busy_cycles >= last.busy_cycles);
+        ASSERT(now.idle_cycles >= last.idle_cycles);
+        last = now;
+      }
+    }};
+    for (int i = 0; i < 100; ++i) {
+      runtime.Spawn(Sleeper, nullptr);
+    }
+    runtime.Shutdown();
+    done = true;
+    reader.join();
+  }
+  chloros::SchedulerStats after = chloros::GetSchedulerStats();
+  ASSERT(after.total.spawns - before.total.spawns == 100);
+  ASSERT(after.total.exits - before.total.exits == 100);
+  // The workers are gone.
+  ASSERT(after.kernel_threads.size() == 1);
+}
+
+int main() {
+  chloros::Initialize();
+  if (!chloros::GetSchedulerStats().enabled) {
+    LOG("Built without statistics, skipping stats test.");
+    return 0;
+  }
+  CheckCounters();
+  CheckPerThread();
+  CheckRuntime();
+  LOG("Stats test passed!");
+  return 0;
+}
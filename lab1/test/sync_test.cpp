@@ -0,0 +1,153 @@
+#include <chloros.h>
+#include <common.h>
+#include <sync.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+chloros::Mutex mutex{};
+int counter = 0;
+
+// Holds the mutex across yields, so everyone else has to wait for it.
+void Incrementer(void*) {
+  for (int i = 0; i < 10; ++i) {
+    std::lock_guard<chloros::Mutex> lock{mutex};
+    int value = counter;
+    chloros::Yield();
+    counter = value + 1;
+  }
+}
+
+static void CheckMutex() {
+  counter = 0;
+  for (int i = 0; i < 10; ++i) {
+    chloros::Spawn(Incrementer, nullptr);
+  }
+  chloros::Wait();
+  ASSERT(counter == 100, "Lost updates.");
+  ASSERT(mutex.try_lock());
+  ASSERT(!mutex.try_lock());
+  mutex.unlock();
+}
+
+chloros::CondVar not_empty{};
+chloros::CondVar not_full{};
+std::deque<int> queue{};
+constexpr size_t const kQueueSize = 2;
+std::vector<int> consumed{};
+
+void Producer(void*) {
+  for (int i = 0; i < 20; ++i) {
+    std::lock_guard<chloros::Mutex> lock{mutex};
+    not_full.Wait(mutex, [] { return queue.size() < kQueueSize; });
+    queue.push_back(i);
+    not_empty.Signal();
+  }
+}
+
+void Consumer(void*) {
+  for (int i = 0; i < 20; ++i) {
+    std::lock_guard<chloros::Mutex> lock{mutex};
+    not_empty.Wait(mutex, [] { return !queue.empty(); });
+    consumed.push_back(queue.front());
+    queue.pop_front();
+    not_full.Signal();
+  }
+}
+
+static void CheckCondVar() {
+  chloros::Spawn(Consumer, nullptr);
+  // The consumer is parked, not waiting for its turn.
+  ASSERT(chloros::GetThreadCount().first == 1);
+  chloros::Spawn(Producer, nullptr);
+  chloros::Wait();
+  ASSERT(consumed.size() == 20);
+  for (int i = 0; i < 20; ++i) {
+    ASSERT(consumed[i] == i, "Wrong order.");
+  }
+}
+
+chloros::Semaphore semaphore{2};
+int inside = 0;
+int max_inside = 0;
+
+void Limited(void*) {
+  semaphore.Acquire();
+  ++inside;
+  max_inside = std::max(max_inside, inside);
+  chloros::Yield();
+  chloros::Yield();
+  --inside;
+  semaphore.Release();
+}
+
+static void CheckSemaphore() {
+  for (int i = 0; i < 10; ++i) {
+    chloros::Spawn(Limited, nullptr);
+  }
+  chloros::Wait();
+  ASSERT(max_inside == 2, "Semaphore let %d threads in.", max_inside);
+  ASSERT(semaphore.TryAcquire() && semaphore.TryAcquire());
+  ASSERT(!semaphore.TryAcquire());
+  semaphore.Release(2);
+}
+
+// Green threads on several kernel threads contending for one mutex.
+constexpr int const kKernelThreads = 4;
+constexpr int const kGreenThreadsPerKernelThread = 4;
+constexpr int const kIncrements = 1000;
+
+std::atomic<int> ready_kernel_threads{0};
+chloros::Mutex shared_mutex{};
+int64_t shared_counter = 0;
+
+void SharedIncrementer(void*) {
+  for (int i = 0; i < kIncrements; ++i) {
+    std::lock_guard<chloros::Mutex> lock{shared_mutex};
+    int64_t value = shared_counter;
+    if (i % 7 == 0) {
+      chloros::Yield();
+    }
+    shared_counter = value + 1;
+  }
+}
+
+void KernelThreadWorker() {
+  chloros::Initialize();
+  ready_kernel_threads++;
+  while (ready_kernel_threads < kKernelThreads) {
+    std::this_thread::yield();
+  }
+  for (int i = 0; i < kGreenThreadsPerKernelThread; ++i) {
+    chloros::SpawnDetached(SharedIncrementer, nullptr);
+  }
+  chloros::Wait();
+}
+
+static void CheckAcrossKernelThreads() {
+  std::vector<std::thread> threads{};
+  for (int i = 0; i < kKernelThreads; ++i) {
+    threads.emplace_back(KernelThreadWorker);
+  }
+  for (auto&& thread : threads) {
+    thread.join();
+  }
+  ASSERT(shared_counter ==
+             kKernelThreads * kGreenThreadsPerKernelThread * kIncrements,
+         "Lost updates.");
+}
+
+int main() {
+  chloros::Initialize();
+  CheckMutex();
+  CheckCondVar();
+  CheckSemaphore();
+  CheckAcrossKernelThreads();
+  LOG("Sync test passed!");
+  return 0;
+}
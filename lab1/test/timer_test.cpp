@@ -0,0 +1,268 @@
+#include <channel.h>
+#include <chloros.h>
+#include <common.h>
+#include <io.h>
+#include <sync.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <unistd.h>
+#include <vector>
+
+using chloros::Clock;
+using chloros::Deadline;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+
+static int64_t MicrosecondsSince(Deadline deadline) {
+  return std::chrono::duration_cast<microseconds>(Clock::now() - deadline)
+      .count();
+}
+
+static int64_t Median(std::vector<int64_t> values) {
+  std::sort(values.begin(), values.end());
+  return values[values.size() / 2];
+}
+
+// Threads started in reverse order of their deadlines wake up in order.
+constexpr int const kOrdered = 10;
+Deadline order_base{};
+std::vector<int> woken_order{};
+
+void OrderedSleeper(void* arg) {
+  int i = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+  Deadline deadline = order_base + milliseconds{2 * i};
+  chloros::SleepUntil(deadline);
+  ASSERT(Clock::now() >= deadline, "Woke up early.");
+  woken_order.push_back(i);
+}
+
+static void CheckOrder() {
+  order_base = Clock::now() + milliseconds{5};
+  for (int i = kOrdered - 1; i >= 0; --i) {
+    chloros::SpawnDetached(OrderedSleeper,
+                           reinterpret_cast<void*>(intptr_t{i}));
+  }
+  chloros::Wait();
+  ASSERT(woken_order.size() == kOrdered);
+  for (int i = 0; i < kOrdered; ++i) {
+    ASSERT(woken_order[i] == i, "Thread %d woke up out of order.",
+           woken_order[i]);
+  }
+  // Nothing to sleep for.
+  auto begin = Clock::now();
+  chloros::SleepFor(microseconds{0});
+  chloros::SleepUntil(begin - milliseconds{1});
+  ASSERT(Clock::now() - begin < milliseconds{1});
+}
+
+// Short sleeps of one thread end within microseconds of their deadline.
+static void CheckPrecision() {
+  std::vector<int64_t> lateness{};
+  for (int i = 0; i < 200; ++i) {
+    Deadline deadline = Clock::now() + microseconds{100 + i % 7 * 30};
+    chloros::SleepUntil(deadline);
+    int64_t late = MicrosecondsSince(deadline);
+    ASSERT(late >= 0, "Woke up %d us early.", static_cast<int>(-late));
+    lateness.push_back(late);
+  }
+  int64_t median = Median(lateness);
+  ASSERT(median < 200, "Sleeps end %d us late.", static_cast<int>(median));
+}
+
+// Lots of threads sleeping at once, with deadlines spread over a second. While
+// they all sleep, the kernel thread hardly uses any CPU. Once they wake up, a
+// debug build takes longer than that second to get through all of them, so
+// only lone sleeps are held to a tight schedule above.
+constexpr int const kSleepers = 100000;
+Deadline sleepers_base{};
+int sleeping = 0;
+std::vector<int64_t> sleeper_lateness(kSleepers);
+
+void Sleeper(void* arg) {
+  int i = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+  Deadline deadline = sleepers_base + microseconds{i % 10000 * 100};
+  ++sleeping;
+  chloros::SleepUntil(deadline);
+  sleeper_lateness[i] = MicrosecondsSince(deadline);
+  --sleeping;
+}
+
+static double CpuSeconds() {
+  timespec now{};
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void CheckManySleepers() {
+  sleepers_base = Clock::now() + milliseconds{1500};
+  std::vector<void*> args(kSleepers);
+  for (int i = 0; i < kSleepers; ++i) {
+    args[i] = reinterpret_cast<void*>(intptr_t{i});
+  }
+  chloros::SpawnOptions options{};
+  options.stack_size = 1 << 14;
+  options.guard_page = false;
+  chloros::SpawnMany(Sleeper, args.data(), kSleepers, options);
+  // They all get to run before we wake up.
+  while (sleeping < kSleepers) {
+    chloros::SleepFor(milliseconds{10});
+  }
+  ASSERT(Clock::now() < sleepers_base - milliseconds{300},
+         "Took too long to put everyone to sleep.");
+
+  double cpu = CpuSeconds();
+  auto begin = Clock::now();
+  chloros::SleepUntil(sleepers_base - milliseconds{50});
+  std::chrono::duration<double> idle = Clock::now() - begin;
+  double busy = (CpuSeconds() - cpu) / idle.count();
+  ASSERT(busy < 0.1, "Busy %.0f%% of the time while idle.", busy * 100);
+
+  chloros::Wait();
+  ASSERT(sleeping == 0);
+  for (int64_t late : sleeper_lateness) {
+    ASSERT(late >= 0, "Woke up %d us early.", static_cast<int>(-late));
+  }
+}
+
+// Timeouts on everything threads can block on, both running out and the
+// thread being woken up in time.
+chloros::Mutex mutex{};
+chloros::CondVar cond{};
+chloros::Semaphore semaphore{};
+chloros::Channel<int> channel{0};
+chloros::Channel<int> other_channel{0};
+int pipe_fds[2];
+
+template <typename Wait>
+static void ExpectTimeout(Wait wait) {
+  auto begin = Clock::now();
+  ASSERT(!wait(), "Did not time out.");
+  ASSERT(Clock::now() - begin >= milliseconds{2}, "Timed out early.");
+}
+
+void LockTimesOut(void*) {
+  ExpectTimeout([] { return mutex.try_lock_for(milliseconds{2}); });
+}
+
+void LockInTime(void*) {
+  ASSERT(mutex.try_lock_for(milliseconds{1000}));
+  mutex.unlock();
+}
+
+void Signaller(void*) {
+  std::lock_guard<chloros::Mutex> lock{mutex};
+  cond.Signal();
+}
+
+void Releaser(void*) {
+  chloros::SleepFor(milliseconds{1});
+  semaphore.Release();
+}
+
+void Sender(void* arg) {
+  chloros::SleepFor(milliseconds{1});
+  static_cast<chloros::Channel<int>*>(arg)->Send(42);
+}
+
+void PipeWriter(void*) {
+  chloros::SleepFor(milliseconds{1});
+  ASSERT(write(pipe_fds[1], "x", 1) == 1);
+}
+
+static void CheckTimeouts() {
+  mutex.lock();
+  chloros::Spawn(LockTimesOut, nullptr).Join();
+  chloros::JoinHandle locker = chloros::Spawn(LockInTime, nullptr);
+  chloros::SleepFor(milliseconds{1});
+  mutex.unlock();
+  locker.Join();
+
+  mutex.lock();
+  ExpectTimeout([] { return cond.WaitFor(mutex, milliseconds{2}); });
+  ASSERT(!mutex.try_lock(), "Mutex not locked again.");
+  // It blocks on the mutex until we wait.
+  chloros::JoinHandle signaller = chloros::Spawn(Signaller, nullptr);
+  ASSERT(cond.WaitFor(mutex, milliseconds{1000}));
+  mutex.unlock();
+  signaller.Join();
+
+  ExpectTimeout([] { return semaphore.TryAcquireFor(milliseconds{2}); });
+  chloros::Spawn(Releaser, nullptr);
+  ASSERT(semaphore.TryAcquireFor(milliseconds{1000}));
+
+  int value = 0;
+  ExpectTimeout([&] { return channel.ReceiveFor(&value, milliseconds{2}); });
+  ExpectTimeout([] { return channel.SendFor(1, milliseconds{2}); });
+  ASSERT(!channel.closed());
+  // Neither left a waiter behind.
+  ASSERT(!channel.TrySend(value));
+  ASSERT(!channel.TryReceive(&value));
+  chloros::Spawn(Sender, &channel);
+  ASSERT(channel.ReceiveFor(&value, milliseconds{1000}) && value == 42);
+
+  int other_value = 0;
+  chloros::Select select{};
+  select.Receive(channel, &value);
+  select.Receive(other_channel, &other_value);
+  ExpectTimeout([&] { return select.WaitFor(milliseconds{2}) >= 0; });
+  ASSERT(!other_channel.TrySend(other_value));
+  chloros::Spawn(Sender, &other_channel);
+  ASSERT(select.WaitFor(milliseconds{1000}) == 1 && other_value == 42);
+
+  ASSERT(pipe(pipe_fds) == 0);
+  ExpectTimeout([] {
+    return chloros::io::WaitReadable(pipe_fds[0],
+                                     Clock::now() + milliseconds{2});
+  });
+  chloros::Spawn(PipeWriter, nullptr);
+  ASSERT(chloros::io::WaitReadable(pipe_fds[0],
+                                   Clock::now() + milliseconds{1000}));
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+  chloros::Wait();
+}
+
+// Timeouts racing with the mutex being handed over.
+constexpr int const kContenders = 20;
+constexpr int const kAttempts = 200;
+int held = 0;
+int timed_out = 0;
+
+void Contender(void* arg) {
+  int id = static_cast<int>(reinterpret_cast<intptr_t>(arg));
+  for (int i = 0; i < kAttempts; ++i) {
+    if (mutex.try_lock_for(microseconds{(id + i) % 50})) {
+      ++held;
+      chloros::Yield();
+      mutex.unlock();
+    } else {
+      ++timed_out;
+    }
+  }
+}
+
+static void CheckContendedTimeouts() {
+  for (int i = 0; i < kContenders; ++i) {
+    chloros::SpawnDetached(Contender, reinterpret_cast<void*>(intptr_t{i}));
+  }
+  chloros::Wait();
+  ASSERT(held + timed_out == kContenders * kAttempts);
+  ASSERT(held > 0 && timed_out > 0, "%d held, %d timed out.", held,
+         timed_out);
+  ASSERT(mutex.try_lock(), "Mutex left locked.");
+  mutex.unlock();
+}
+
+int main() {
+  chloros::Initialize();
+  CheckOrder();
+  CheckPrecision();
+  CheckManySleepers();
+  CheckTimeouts();
+  CheckContendedTimeouts();
+  LOG("Timer test passed!");
+  return 0;
+}
@@ -0,0 +1,194 @@
+#include <chloros.h>
+#include <common.h>
+#include <runtime.h>
+#include <sync.h>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using chloros::TraceEvent;
+using chloros::TraceEventType;
+
+// Events about `thread`, apart from switches away from it.
+static std::vector<TraceEventType> TypesOf(
+    std::vector<TraceEvent> const& events, uint64_t thread) {
+  std::vector<TraceEventType> types{};
+  for (TraceEvent const& event : events) {
+    if (event.thread == thread && event.type != TraceEventType::kIdle) {
+      types.push_back(event.type);
+    }
+  }
+  return types;
+}
+
+static void CheckOrdered(std::vector<TraceEvent> const& events) {
+  for (size_t i = 1; i < events.size(); ++i) {
+    ASSERT(events[i - 1].tsc <= events[i].tsc, "Events out of order.");
+  }
+  for (TraceEvent const& event : events) {
+    ASSERT(event.type <= TraceEventType::kSteal, "Torn event.");
+  }
+}
+
+// Nothing is recorded while the tracer is off.
+void Noop(void*) {}
+
+static void CheckOff() {
+  chloros::Spawn(Noop, nullptr);
+  chloros::Wait();
+  ASSERT(chloros::GetTrace().empty());
+}
+
+// A thread's life, from spawn to exit, in order.
+chloros::Semaphore release{};
+
+void Lifetime(void*) { release.Acquire(); }
+
+void Releaser(void*) { release.Release(); }
+
+static void CheckLifetime() {
+  chloros::SetTracing(true);
+  uint64_t self = chloros::CurrentThread()->id;
+  chloros::JoinHandle handle = chloros::Spawn(Lifetime, nullptr);
+  chloros::JoinHandle releaser = chloros::Spawn(Releaser, nullptr);
+  chloros::Wait();
+  chloros::SetTracing(false);
+  std::vector<TraceEvent> events = chloros::GetTrace();
+  CheckOrdered(events);
+  std::vector<TraceEventType> expected{
+      TraceEventType::kSpawn, TraceEventType::kSwitch, TraceEventType::kPark,
+      TraceEventType::kWake,  TraceEventType::kSwitch, TraceEventType::kExit,
+  };
+  ASSERT(TypesOf(events, handle.id()) == expected, "Wrong events.");
+  for (TraceEvent const& event : events) {
+    ASSERT(event.kernel_thread == events.front().kernel_thread);
+    if (event.thread == handle.id() && event.type == TraceEventType::kSpawn) {
+      ASSERT(event.arg == self);
+    }
+    if (event.thread == handle.id() && event.type == TraceEventType::kWake) {
+      ASSERT(event.arg == releaser.id());
+    }
+  }
+
+  // Nothing more once it is off, and it starts afresh when back on.
+  chloros::Spawn(Noop, nullptr);
+  ASSERT(chloros::GetTrace().size() == events.size());
+  chloros::SetTracing(true);
+  ASSERT(chloros::GetTrace().empty());
+  chloros::SetTracing(false);
+}
+
+// Only the latest events are kept.
+bool stop = false;
+
+void Yielder(void*) {
+  while (!stop) {
+    chloros::Yield();
+  }
+}
+
+static void CheckOverwrite() {
+  chloros::SpawnDetached(Yielder, nullptr);
+  chloros::SetTracing(true);
+  for (size_t i = 0; i < chloros::kTraceEvents; ++i) {
+    chloros::Yield();
+  }
+  chloros::SetTracing(false);
+  stop = true;
+  chloros::Wait();
+  std::vector<TraceEvent> events = chloros::GetTrace();
+  CheckOrdered(events);
+  // Less the oldest one, which a reader cannot tell from one being written.
+  ASSERT(events.size() == chloros::kTraceEvents - 1, "%zu events.",
+         events.size());
+  ASSERT(events.back().type == TraceEventType::kSwitch);
+}
+
+// Kernel threads record their own events, and can be read from outside while
+// they do.
+constexpr int const kSpinners = 64;
+constexpr int const kSpins = 200;
+
+void Spinner(void*) {
+  for (int i = 0; i < kSpins; ++i) {
+    chloros::Yield();
+  }
+}
+
+static void CheckRuntime() {
+  chloros::SetTracing(true);
+  {
+    chloros::RuntimeOptions options{};
+    options.workers = 2;
+    options.pin_workers = false;
+    chloros::Runtime runtime{options};
+    for (int i = 0; i < kSpinners; ++i) {
+      runtime.Spawn(Spinner, nullptr);
+    }
+    std::atomic<bool> done{false};
+    std::thread reader{[&done] {
+      while (!done) {
+        CheckOrdered(chloros::GetTrace());
+      }
+    }};
+    runtime.Shutdown();
+    done = true;
+    reader.join();
+  }
+  chloros::SetTracing(false);
+  std::vector<TraceEvent> events = chloros::GetTrace();
+  CheckOrdered(events);
+  // The workers ran the threads, which we spawned.
+  std::set<uint32_t> workers{};
+  std::set<uint32_t> spawners{};
+  for (TraceEvent const& event : events) {
+    if (event.type == TraceEventType::kSwitch) {
+      workers.insert(event.kernel_thread);
+    } else if (event.type == TraceEventType::kSpawn) {
+      spawners.insert(event.kernel_thread);
+    }
+  }
+  ASSERT(workers.size() == 2, "Switches on %zu kernel threads.",
+         workers.size());
+  ASSERT(spawners.size() == 1 && workers.count(*spawners.begin()) == 0);
+}
+
+// The trace comes out as JSON with a slice per run of a thread.
+static void CheckChromeTrace() {
+  chloros::SetTracing(true);
+  chloros::Spawn(Lifetime, nullptr);
+  chloros::Spawn(Releaser, nullptr);
+  chloros::Wait();
+  chloros::SetTracing(false);
+  char const* path = "/tmp/chloros_trace_test.json";
+  ASSERT(chloros::WriteChromeTrace(path));
+  std::ifstream file{path};
+  std::stringstream contents{};
+  contents << file.rdbuf();
+  std::string json = contents.str();
+  remove(path);
+  ASSERT(json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[") == 0);
+  ASSERT(json.find("\"ph\":\"X\"") != std::string::npos);
+  ASSERT(json.find("\"name\":\"park\"") != std::string::npos);
+  ASSERT(json.find("\"name\":\"wake\"") != std::string::npos);
+  ASSERT(json.find("\"name\":\"kernel thread") != std::string::npos);
+  ASSERT(json.rfind("\n]}\n") == json.size() - 4);
+  ASSERT(!chloros::WriteChromeTrace("/nonexistent/trace.json"));
+}
+
+int main() {
+  chloros::Initialize();
+  CheckOff();
+  CheckLifetime();
+  CheckOverwrite();
+  CheckRuntime();
+  CheckChromeTrace();
+  LOG("Trace test passed!");
+  return 0;
+}
@@ -0,0 +1,116 @@
+#include <chloros.h>
+#include <common.h>
+#include <cstdint>
+#include <cstring>
+
+// Threads spawned with `SpawnOptions::vector_state` keep their vector
+// registers across switches, even when the compiler knows nothing about it.
+
+constexpr int const kRounds = 100;
+constexpr int const kVectorThreads = 2;
+
+extern "C" void YieldFromAssembly() { chloros::Yield(); }
+
+// Load `in` into %ymm8, yield from assembly so that the compiler has no chance
+// to spill it, and store what %ymm8 holds afterwards to `out`. Every register
+// the call may touch is clobbered, which leaves the pointers in callee-saved
+// ones.
+static void HoldAcrossYield(uint8_t const* in, uint8_t* out) {
+  __asm__ volatile(
+      "vmovdqu (%[in]), %%ymm8\n\t"
+      "movq %%rsp, %%rbx\n\t"
+      // Stay clear of the red zone, and call with an aligned stack.
+      "subq $128, %%rsp\n\t"
+      "andq $-16, %%rsp\n\t"
+      "call *%[yield]\n\t"
+      "movq %%rbx, %%rsp\n\t"
+      "vmovdqu %%ymm8, (%[out])\n\t"
+      :
+      : [in] "r"(in), [out] "r"(out), [yield] "r"(YieldFromAssembly)
+      : "rax", "rbx", "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "r11",
+        "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+        "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15",
+        "memory", "cc");
+}
+
+static uint32_t Mxcsr() {
+  uint32_t mxcsr = 0;
+  __asm__ volatile("stmxcsr %0" : "=m"(mxcsr));
+  return mxcsr;
+}
+
+int mismatches = 0;
+
+void VectorWorker(void* arg) {
+  // New threads start with the default floating point environment.
+  ASSERT(Mxcsr() == 0x1F80, "MXCSR is 0x%x.", Mxcsr());
+  uint8_t in[32];
+  uint8_t out[32];
+  for (int round = 0; round < kRounds; ++round) {
+    // Different in every byte, so that the upper half counts too.
+    for (int i = 0; i < 32; ++i) {
+      in[i] = static_cast<uint8_t>(reinterpret_cast<intptr_t>(arg) * 64 +
+                                   round + i);
+    }
+    HoldAcrossYield(in, out);
+    if (memcmp(in, out, sizeof(in)) != 0) {
+      ++mismatches;
+    }
+  }
+}
+
+// A plain thread in between scribbles over the same register.
+void PlainWorker(void*) {
+  uint8_t in[32];
+  uint8_t out[32];
+  memset(in, 0xEE, sizeof(in));
+  for (int round = 0; round < kRounds; ++round) {
+    HoldAcrossYield(in, out);
+  }
+}
+
+static void CheckKept() {
+  chloros::SpawnOptions options{};
+  options.vector_state = true;
+  for (int i = 0; i < kVectorThreads; ++i) {
+    chloros::SpawnDetached(VectorWorker, reinterpret_cast<void*>(intptr_t{i}),
+                           options);
+  }
+  chloros::SpawnDetached(PlainWorker, nullptr);
+  chloros::Wait();
+  ASSERT(mismatches == 0, "Lost the vector registers %d times.", mismatches);
+}
+
+// A vector thread that changes its floating point environment keeps it to
+// itself.
+void RoundingWorker(void*) {
+  uint32_t rounding = 0x1F80 | 0x6000;
+  __asm__ volatile("ldmxcsr %0" : : "m"(rounding));
+  for (int i = 0; i < 10; ++i) {
+    chloros::Yield();
+    ASSERT(Mxcsr() == rounding, "MXCSR is 0x%x.", Mxcsr());
+  }
+}
+
+static void CheckEnvironment() {
+  chloros::SpawnOptions options{};
+  options.vector_state = true;
+  chloros::SpawnDetached(RoundingWorker, nullptr, options);
+  for (int i = 0; i < 10; ++i) {
+    chloros::Yield();
+    ASSERT(Mxcsr() == 0x1F80, "MXCSR is 0x%x.", Mxcsr());
+  }
+  chloros::Wait();
+}
+
+int main() {
+  if (!__builtin_cpu_supports("avx")) {
+    LOG("No AVX, skipping vector test.");
+    return 0;
+  }
+  chloros::Initialize();
+  CheckKept();
+  CheckEnvironment();
+  LOG("Vector test passed!");
+  return 0;
+}
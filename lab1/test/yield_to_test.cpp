@@ -0,0 +1,143 @@
+#include <chloros.h>
+#include <common.h>
+#include <runtime.h>
+#include <sync.h>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+std::vector<int> order{};
+chloros::Thread* workers[4]{};
+bool go = false;
+
+void Worker(void* arg) {
+  int id = *reinterpret_cast<int*>(&arg);
+  workers[id] = chloros::CurrentThread();
+  while (!go) {
+    chloros::Yield();
+  }
+  order.push_back(id);
+}
+
+static void SpawnWorkers() {
+  order.clear();
+  for (int i = 0; i < 4; ++i) {
+    workers[i] = nullptr;
+    chloros::SpawnDetached(Worker, reinterpret_cast<void*>(i));
+  }
+}
+
+// The named thread runs next, wherever it is in the queue. Under FIFO the
+// caller goes to the back, behind the others; other policies put it and them
+// wherever they like.
+static void CheckOrder() {
+  go = false;
+  SpawnWorkers();
+  // Let them all get ready to push.
+  while (std::find(workers, workers + 4, nullptr) != workers + 4) {
+    chloros::Yield();
+  }
+  ASSERT(order.empty());
+  go = true;
+  ASSERT(chloros::YieldTo(workers[3]));
+  ASSERT(!order.empty() && order.front() == 3, "Wrong thread ran.");
+  if (strcmp(chloros::GetSchedulingPolicy(), "fifo") == 0) {
+    ASSERT((order == std::vector<int>{3, 0, 1, 2}), "Wrong order.");
+  }
+  chloros::Wait();
+  ASSERT(order.size() == 4);
+}
+
+// Threads that are not ready are left alone.
+chloros::Semaphore blocker{};
+
+void Block(void*) { blocker.Acquire(); }
+
+static void CheckNotReady() {
+  ASSERT(!chloros::YieldTo(chloros::CurrentThread()));
+  chloros::JoinHandle blocked = chloros::Spawn(Block, nullptr);
+  ASSERT(!chloros::YieldTo(blocked));
+  blocker.Release();
+  ASSERT(chloros::YieldTo(blocked));
+  ASSERT(blocked.Finished());
+  ASSERT(!chloros::YieldTo(blocked));
+  chloros::Wait();
+}
+
+// A semaphore hands its unit over and switches to the waiter, ahead of
+// everybody else, and the releasing thread runs right after it.
+chloros::Semaphore request{};
+
+void Consumer(void*) {
+  request.Acquire();
+  order.push_back(-1);
+}
+
+static void CheckReleaseAndSwitch() {
+  chloros::Spawn(Consumer, nullptr);
+  SpawnWorkers();
+  request.ReleaseAndSwitch();
+  ASSERT((order == std::vector<int>{-1}), "Wrong order.");
+  chloros::Wait();
+  // With nobody waiting, the unit stays.
+  request.ReleaseAndSwitch();
+  ASSERT(request.TryAcquire());
+}
+
+// Two threads hand off to each other across kernel threads, past busy ones.
+constexpr int const kHandoffs = 10000;
+
+std::atomic<bool> stop{false};
+std::atomic<chloros::Thread*> partners[2]{};
+std::atomic<int> handoffs{0};
+
+void Busy(void*) {
+  while (!stop) {
+    chloros::Yield();
+  }
+}
+
+void Partner(void* arg) {
+  int self = *reinterpret_cast<int*>(&arg);
+  partners[self] = chloros::CurrentThread();
+  while (partners[1 - self] == nullptr) {
+    chloros::Yield();
+  }
+  while (handoffs < kHandoffs) {
+    // The partner may still be running on the other worker.
+    if (chloros::YieldTo(partners[1 - self])) {
+      ++handoffs;
+    } else {
+      chloros::Yield();
+    }
+  }
+}
+
+static void CheckRuntime() {
+  chloros::RuntimeOptions options{};
+  options.workers = 2;
+  chloros::Runtime runtime{options};
+  // The handles keep the partners' control blocks around.
+  std::vector<chloros::JoinHandle> handles{};
+  for (int i = 0; i < 2; ++i) {
+    handles.push_back(runtime.Spawn(Partner, reinterpret_cast<void*>(i)));
+  }
+  for (int i = 0; i < 10; ++i) {
+    runtime.Spawn(Busy, nullptr);
+  }
+  for (chloros::JoinHandle& handle : handles) {
+    handle.Join();
+  }
+  stop = true;
+}
+
+int main() {
+  chloros::Initialize();
+  CheckOrder();
+  CheckNotReady();
+  CheckReleaseAndSwitch();
+  CheckRuntime();
+  LOG("Yield to test passed!");
+  return 0;
+}